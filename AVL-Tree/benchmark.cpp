@@ -0,0 +1,357 @@
+#include <cassert>
+#include <cstdint>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+#include <memory>
+#include <limits>
+#include <optional>
+#include <algorithm>
+#include <bitset>
+#include <list>
+#include <array>
+#include <vector>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <unordered_map>
+#include <stack>
+#include <queue>
+#include <random>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+
+// The tracker is compiled the same way as by the evaluator, without its tests and main
+#define __PROGTEST__
+#include "main.cpp"
+
+using Clock = std::chrono::steady_clock;
+using Sale = std::pair<int, size_t>;
+
+/**
+ * Function to generate micro-batches of sales over a fixed catalogue of products.
+ * @param batches Number of batches
+ * @param batch_size Number of sales in one batch
+ * @param catalogue Number of distinct products
+ * @param seed Seed of the random generator
+ * @return The generated batches
+ */
+std::vector<std::vector<Sale>> generateBatches(size_t batches, size_t batch_size, size_t catalogue, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::vector<std::vector<Sale>> result(batches);
+    for (auto &batch: result) {
+        batch.reserve(batch_size);
+        for (size_t i = 0; i < batch_size; i++)
+            batch.emplace_back((int) (rng() % catalogue), rng() % 5 + 1);
+    }
+    return result;
+}
+
+/**
+ * Function to measure the time needed to run a callable.
+ * @param work The callable to measure
+ * @return Elapsed time in seconds
+ */
+template<typename Work>
+double measure(Work &&work) {
+    auto start = Clock::now();
+    work();
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * Function to compare repeated sell() with sellBatch() on the same stream of micro-batches.
+ * @param catalogue Number of distinct products
+ * @param batch_size Number of sales in one batch
+ * @param batches Number of batches
+ */
+void benchmarkBatches(size_t catalogue, size_t batch_size, size_t batches) {
+    auto stream = generateBatches(batches, batch_size, catalogue, 1);
+    size_t sales = batch_size * batches;
+
+    Bestsellers<int> single;
+    double single_time = measure([&]() {
+        for (const auto &batch: stream)
+            for (const auto &sale: batch)
+                single.sell(sale.first, sale.second);
+    });
+
+    Bestsellers<int> batched;
+    double batched_time = measure([&]() {
+        for (const auto &batch: stream)
+            batched.sellBatch(batch);
+    });
+
+    assert(single.sold(1, single.products()) == batched.sold(1, batched.products()));
+    std::cout << std::setw(10) << catalogue << std::setw(10) << batch_size
+              << std::setw(14) << (size_t) (sales / single_time)
+              << std::setw(14) << (size_t) (sales / batched_time)
+              << std::setw(9) << std::fixed << std::setprecision(2) << single_time / batched_time << "x" << std::endl;
+}
+
+/**
+ * Function to run a writer thread recording sales while reader threads keep querying, once with the snapshots
+ * of ConcurrentBestsellers and once with Bestsellers guarded by a mutex.
+ * @param catalogue Number of distinct products
+ * @param sales Number of sales recorded by the writer
+ * @param readers Number of reader threads
+ */
+void benchmarkConcurrent(size_t catalogue, size_t sales, size_t readers) {
+    auto stream = generateBatches(1, sales, catalogue, 2)[0];
+    std::atomic<bool> done{false};
+    std::atomic<size_t> queries{0};
+
+    // Readers check that every snapshot is consistent: the ranks are ordered and the range sum matches
+    ConcurrentBestsellers<int> concurrent;
+    auto snapshot_reader = [&](size_t reader) {
+        size_t local = 0;
+        std::mt19937 rng((unsigned) (reader + 1)); // Every reader queries its own sequence of ranks
+        while (!done) {
+            auto snapshot = concurrent.snapshot();
+            size_t n = snapshot->products();
+            if (!n)
+                continue;
+            size_t r = rng() % n + 1;
+            size_t total = snapshot->sold(1, n);
+            if (snapshot->sold(1) < snapshot->sold(n) || snapshot->rank(snapshot->product(r)) != r ||
+                snapshot->sold(1, r) + (r < n ? snapshot->sold(r + 1, n) : 0) != total)
+                throw std::logic_error("inconsistent snapshot");
+            local += 5;
+        }
+        queries += local;
+    };
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < readers; i++)
+        threads.emplace_back(snapshot_reader, i);
+    double snapshot_time = measure([&]() {
+        for (const auto &sale: stream)
+            concurrent.sell(sale.first, sale.second);
+    });
+    done = true;
+    for (auto &thread: threads)
+        thread.join();
+    size_t snapshot_queries = queries;
+
+    Bestsellers<int> locked;
+    std::mutex mutex;
+    done = false;
+    queries = 0;
+    auto locked_reader = [&](size_t reader) {
+        size_t local = 0;
+        std::mt19937 rng((unsigned) (reader + 1)); // Every reader queries its own sequence of ranks
+        while (!done) {
+            std::lock_guard<std::mutex> lock(mutex);
+            size_t n = locked.products();
+            if (!n)
+                continue;
+            size_t r = rng() % n + 1;
+            size_t total = locked.sold(1, n);
+            if (locked.sold(1) < locked.sold(n) || locked.rank(locked.product(r)) != r ||
+                locked.sold(1, r) + (r < n ? locked.sold(r + 1, n) : 0) != total)
+                throw std::logic_error("inconsistent tree");
+            local += 5;
+        }
+        queries += local;
+    };
+    threads.clear();
+    for (size_t i = 0; i < readers; i++)
+        threads.emplace_back(locked_reader, i);
+    double locked_time = measure([&]() {
+        for (const auto &sale: stream) {
+            std::lock_guard<std::mutex> lock(mutex);
+            locked.sell(sale.first, sale.second);
+        }
+    });
+    done = true;
+    for (auto &thread: threads)
+        thread.join();
+
+    std::cout << std::setw(10) << catalogue << std::setw(9) << readers
+              << std::setw(14) << (size_t) (sales / snapshot_time)
+              << std::setw(14) << (size_t) (snapshot_queries / snapshot_time)
+              << std::setw(14) << (size_t) (sales / locked_time)
+              << std::setw(14) << (size_t) (queries / locked_time) << std::endl;
+}
+
+/**
+ * Function to run the same sales and queries against one backend of Bestsellers.
+ * @param stream Sales to record
+ * @param queries Number of rank, product and range queries
+ * @param times Array to store the seconds spent on sales, rank, product and sold(from, to)
+ * @return Checksum of the range sums, the other results depend on the order of ties
+ */
+template<typename Tracker>
+size_t runBackend(const std::vector<Sale> &stream, size_t queries, double (&times)[4]) {
+    Tracker tracker;
+    times[0] = measure([&]() {
+        for (const auto &sale: stream)
+            tracker.sell(sale.first, sale.second);
+    });
+    size_t n = tracker.products();
+    size_t checksum = 0, sink = 0;
+    std::mt19937 rng(3);
+    std::vector<size_t> ranks(queries);
+    for (auto &r: ranks)
+        r = rng() % n + 1;
+    times[1] = measure([&]() {
+        for (size_t r: ranks)
+            sink += tracker.rank((int) (r % n));
+    });
+    times[2] = measure([&]() {
+        for (size_t r: ranks)
+            sink += tracker.product(r);
+    });
+    times[3] = measure([&]() {
+        for (size_t r: ranks)
+            checksum += tracker.sold(r / 2 + 1, r);
+    });
+    if (sink == std::numeric_limits<size_t>::max())
+        std::cout << sink << std::endl;
+    return checksum;
+}
+
+/**
+ * Function to compare the AVL and the B+-tree backend of Bestsellers.
+ * @param catalogue Number of distinct products
+ * @param sales Number of sales
+ * @param queries Number of queries of each kind
+ */
+void benchmarkBackends(size_t catalogue, size_t sales, size_t queries) {
+    std::vector<Sale> stream;
+    stream.reserve(sales + catalogue);
+    for (size_t i = 0; i < catalogue; i++)
+        stream.emplace_back((int) i, 1);
+    auto random_sales = generateBatches(1, sales, catalogue, 4)[0];
+    stream.insert(stream.end(), random_sales.begin(), random_sales.end());
+
+    double avl[4], btree[4];
+    size_t avl_checksum = runBackend<Bestsellers<int, CAvlBackend>>(stream, queries, avl);
+    size_t btree_checksum = runBackend<Bestsellers<int, CBTreeBackend>>(stream, queries, btree);
+    assert(avl_checksum == btree_checksum);
+    const char *names[] = {"sell", "rank", "product", "sold range"};
+    for (size_t i = 0; i < 4; i++) {
+        size_t ops = i ? queries : stream.size();
+        std::cout << std::setw(10) << catalogue << std::setw(12) << names[i]
+                  << std::setw(14) << (size_t) (ops / avl[i])
+                  << std::setw(14) << (size_t) (ops / btree[i])
+                  << std::setw(9) << std::fixed << std::setprecision(2) << avl[i] / btree[i] << "x" << std::endl;
+    }
+}
+
+/**
+ * Function to compare rebuilding a tracker by replaying its sales with loading it from a saved copy.
+ * @param catalogue Number of distinct products
+ * @param sales Number of sales in the log
+ */
+void benchmarkReload(size_t catalogue, size_t sales) {
+    std::vector<Sale> log;
+    log.reserve(sales + catalogue);
+    for (size_t i = 0; i < catalogue; i++)
+        log.emplace_back((int) i, 1);
+    auto random_sales = generateBatches(1, sales, catalogue, 5)[0];
+    log.insert(log.end(), random_sales.begin(), random_sales.end());
+
+    Bestsellers<int> replayed;
+    double replay_time = measure([&]() {
+        for (const auto &sale: log)
+            replayed.sell(sale.first, sale.second);
+    });
+    std::stringstream saved;
+    double save_time = measure([&]() { replayed.save(saved); });
+    Bestsellers<int> loaded;
+    double load_time = measure([&]() { loaded.load(saved); });
+
+    assert(loaded.sold(1, loaded.products()) == replayed.sold(1, replayed.products()));
+    std::cout << std::setw(10) << catalogue << std::setw(10) << log.size()
+              << std::setw(12) << std::fixed << std::setprecision(3) << replay_time
+              << std::setw(12) << save_time << std::setw(12) << load_time
+              << std::setw(12) << saved.str().size() / 1024 << std::endl;
+}
+
+/**
+ * Function to compare one tree with a sharded tracker, on parallel batches and on global queries.
+ * @param catalogue Number of distinct products
+ * @param shard_count Number of shards
+ */
+void benchmarkSharded(size_t catalogue, size_t shard_count) {
+    auto stream = generateBatches(20, 100000, catalogue, 6);
+    size_t sales = 20 * 100000, queries = 100000;
+
+    Bestsellers<int> single;
+    double single_sell = measure([&]() {
+        for (const auto &batch: stream)
+            single.sellBatch(batch);
+    });
+    ShardedBestsellers<int> sharded(shard_count);
+    double sharded_sell = measure([&]() {
+        for (const auto &batch: stream)
+            sharded.sellBatch(batch);
+    });
+
+    std::mt19937 rng(8);
+    size_t n = single.products(), single_sum = 0, sharded_sum = 0;
+    std::vector<size_t> ranks(queries);
+    for (auto &r: ranks)
+        r = rng() % n + 1;
+    double single_query = measure([&]() {
+        for (size_t r: ranks)
+            single_sum += single.sold(r) + single.sold(1, r);
+    });
+    double sharded_query = measure([&]() {
+        for (size_t r: ranks)
+            sharded_sum += sharded.sold(r) + sharded.sold(1, r);
+    });
+
+    assert(single_sum == sharded_sum);
+    std::cout << std::setw(10) << catalogue << std::setw(8) << shard_count
+              << std::setw(14) << (size_t) (sales / single_sell)
+              << std::setw(14) << (size_t) (sales / sharded_sell)
+              << std::setw(14) << (size_t) (2 * queries / single_query)
+              << std::setw(14) << (size_t) (2 * queries / sharded_query) << std::endl;
+}
+
+/**
+ * Main function to run the benchmarks.
+ * @return 0
+ */
+int main() {
+    std::cout << "sell() vs sellBatch(), sales per second" << std::endl;
+    std::cout << std::setw(10) << "products" << std::setw(10) << "batch"
+              << std::setw(14) << "sell" << std::setw(14) << "sellBatch" << std::setw(10) << "gain" << std::endl;
+    for (size_t catalogue: {10000, 100000, 1000000})
+        for (size_t batch_size: {10000, 100000})
+            benchmarkBatches(catalogue, batch_size, 20);
+
+    std::cout << std::endl << "Snapshots vs a mutex, sales and queries per second while reading" << std::endl;
+    std::cout << std::setw(10) << "products" << std::setw(9) << "readers"
+              << std::setw(14) << "snap sell" << std::setw(14) << "snap query"
+              << std::setw(14) << "lock sell" << std::setw(14) << "lock query" << std::endl;
+    for (size_t readers: {1, 2, 4})
+        benchmarkConcurrent(100000, 300000, readers);
+
+    std::cout << std::endl << "AVL vs B+-tree backend, operations per second" << std::endl;
+    std::cout << std::setw(10) << "products" << std::setw(12) << "operation"
+              << std::setw(14) << "AVL" << std::setw(14) << "B+-tree" << std::setw(10) << "gain" << std::endl;
+    for (size_t catalogue: {10000, 100000, 1000000})
+        benchmarkBackends(catalogue, 2000000, 1000000);
+
+    std::cout << std::endl << "Replaying the sales log vs loading a saved tracker, seconds" << std::endl;
+    std::cout << std::setw(10) << "products" << std::setw(10) << "sales" << std::setw(12) << "replay"
+              << std::setw(12) << "save" << std::setw(12) << "load" << std::setw(12) << "KiB" << std::endl;
+    for (size_t catalogue: {100000, 1000000})
+        benchmarkReload(catalogue, 10000000);
+
+    std::cout << std::endl << "One tree vs shards, sales and global queries per second" << std::endl;
+    std::cout << std::setw(10) << "products" << std::setw(8) << "shards"
+              << std::setw(14) << "tree sell" << std::setw(14) << "shard sell"
+              << std::setw(14) << "tree query" << std::setw(14) << "shard query" << std::endl;
+    for (size_t shard_count: {2, 4, 8})
+        benchmarkSharded(1000000, shard_count);
+    return 0;
+}
@@ -2,7 +2,17 @@
 #ifndef __PROGTEST__
 
 #include <cassert>
+#include <cstdint>
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <stdexcept>
+#include <type_traits>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
 #include <memory>
 #include <limits>
 #include <optional>
@@ -17,32 +27,248 @@
 #include <stack>
 #include <queue>
 #include <random>
+#include <tuple>
 
 #endif
 
+#ifdef BESTSELLERS_STATS
+// Counters of the work done on the hot paths of all trackers of the program, for profiling only and not thread-safe
+struct CBestsellersStats {
+    size_t rotations = 0; // Single rotations of the AVL tree
+    size_t allocations = 0; // AVL nodes appended to a node pool
+    size_t reuses = 0; // AVL nodes taken from the free list of a node pool
+    size_t releases = 0; // AVL nodes returned to the free list
+    size_t splits = 0; // Nodes split by the B+-tree backend
+    size_t compactions = 0; // Rebuilds of the B+-tree backend
+};
+
+inline CBestsellersStats bestsellers_stats;
+
+#define BESTSELLERS_COUNT(counter) (bestsellers_stats.counter++)
+#else
+#define BESTSELLERS_COUNT(counter) ((void) 0)
+#endif
+
+// Index used in place of a null child and as the end marker of the free list
+constexpr uint32_t NIL_NODE = std::numeric_limits<uint32_t>::max();
+
 // Structure representing a node in the AVL tree
 template<typename Product>
 struct CNode {
 public:
-    std::shared_ptr<CNode> left; // Pointer to the left child
-    std::shared_ptr<CNode> right; // Pointer to the right child
+    uint32_t left; // Index of the left child in the node pool
+    uint32_t right; // Index of the right child in the node pool
+    uint32_t height; // Height of the node in the AVL tree
     std::vector<Product> products; // List of products in this node
-    size_t height; // Height of the node in the AVL tree
     size_t amount{}; // Amount of the product (used for ranking)
     size_t children_cnt; // Count of child nodes
     size_t children_product_cnt; // Count of products in child nodes
 
     // Constructor for CNode
-    CNode() : left(nullptr), right(nullptr), height(1), amount(0), children_cnt(0), children_product_cnt(0) {}
+    CNode() : left(NIL_NODE), right(NIL_NODE), height(1), amount(0), children_cnt(0), children_product_cnt(0) {}
+};
+
+// Arena holding all nodes of one tree in a contiguous vector, children are linked by 32-bit indices
+template<typename Product>
+struct CNodePool {
+    std::vector<CNode<Product>> nodes; // Storage of all nodes, live and released
+    uint32_t free_head = NIL_NODE; // First released node, released nodes are chained through their left index
+    size_t live = 0; // Number of nodes currently in use
+
+    CNode<Product> &operator[](uint32_t index) { return nodes[index]; }
+
+    const CNode<Product> &operator[](uint32_t index) const { return nodes[index]; }
+
+    /**
+     * Function to reserve space for the given number of nodes in advance.
+     * @param count Number of nodes
+     */
+    void reserve(size_t count) {
+        nodes.reserve(count);
+    }
+
+    /**
+     * Function to take a node from the free list, or append a new one when the free list is empty.
+     * A recycled node keeps the capacity of its products vector, so reusing it does not allocate.
+     * @return Index of the node
+     */
+    uint32_t allocate() {
+        live++;
+        if (free_head != NIL_NODE) {
+            BESTSELLERS_COUNT(reuses);
+            uint32_t index = free_head;
+            free_head = nodes[index].left;
+            return index;
+        }
+        if (nodes.size() >= NIL_NODE)
+            throw std::length_error("node pool is full");
+        BESTSELLERS_COUNT(allocations);
+        nodes.emplace_back();
+        return static_cast<uint32_t>(nodes.size() - 1);
+    }
+
+    /**
+     * Function to return a node to the free list.
+     * @param index Index of the node
+     */
+    void release(uint32_t index) {
+        BESTSELLERS_COUNT(releases);
+        live--;
+        nodes[index].products.clear();
+        nodes[index].right = NIL_NODE;
+        nodes[index].left = free_head;
+        free_head = index;
+    }
+};
+
+// Slot of a product that has a mapping entry but is not stored in the tree yet
+constexpr uint32_t NIL_SLOT = std::numeric_limits<uint32_t>::max();
+
+// Flag set in the slot of a product while a batch accumulates its sales
+constexpr uint32_t PENDING_SLOT = uint32_t(1) << 31;
+
+// Ratio of tree size to distinct products in a batch above which the batch is applied product by product
+constexpr size_t BATCH_REBUILD_RATIO = 4;
+
+// Structure describing where a product is stored in the AVL tree
+struct CProductEntry {
+    size_t amount; // Amount of the product, selects the node
+    uint32_t slot; // Position of the product in the products vector of the node
+};
+
+// Product visited by CRankIterator
+template<typename Product>
+struct CRankedProduct {
+    const Product &product; // The product, stored in the tree
+    size_t amount; // Number of copies sold
+    size_t rank; // Rank of the product
+};
+
+// Iterator over the products of a Bestsellers tree from the best rank to the worst one. It walks the tree in
+// reverse order with an explicit stack, so visiting K consecutive ranks costs O(log n + K). Any sale invalidates it.
+template<typename Product>
+struct CRankIterator {
+    const CNodePool<Product> *pool = nullptr; // Nodes of the tree
+    std::vector<uint32_t> stack; // Nodes with better ranks than the left subtree of the current node, still to visit
+    uint32_t node = NIL_NODE; // Node whose bucket is being visited, NIL_NODE at the end
+    size_t offset = 0; // Position in the bucket of the current node
+    size_t rank = 0; // Rank of the current product
+
+    CRankedProduct<Product> operator*() const {
+        const CNode<Product> &n = (*pool)[node];
+        return {n.products[offset], n.amount, rank};
+    }
+
+    CRankIterator &operator++() {
+        rank++;
+        if (++offset < (*pool)[node].products.size())
+            return *this;
+        offset = 0;
+        pushRightSpine((*pool)[node].left);
+        if (stack.empty())
+            node = NIL_NODE;
+        else {
+            node = stack.back();
+            stack.pop_back();
+        }
+        return *this;
+    }
+
+    bool operator==(const CRankIterator &other) const {
+        return node == other.node && offset == other.offset;
+    }
+
+    bool operator!=(const CRankIterator &other) const {
+        return !(*this == other);
+    }
+
+    /**
+     * Function to push a node and all right children below it, the best ranks of its subtree end on top.
+     * @param from Index of the node
+     */
+    void pushRightSpine(uint32_t from) {
+        for (; from != NIL_NODE; from = (*pool)[from].right)
+            stack.push_back(from);
+    }
+};
+
+// Magic number and format version at the start of a saved Bestsellers
+constexpr uint32_t SAVE_MAGIC = 0x53545342; // "BSTS" in little endian
+constexpr uint32_t SAVE_VERSION = 1;
+
+// Largest number of products or characters allocated before they are read, so corrupted counts and lengths fail on
+// the end of the stream instead of allocating gigabytes up front
+constexpr size_t SAVE_READ_CHUNK = size_t(1) << 16;
+
+// Binary encoding of the products of one bucket of a saved Bestsellers. Trivially copyable products are stored
+// as a contiguous array of their bytes, so a bucket can be read or mapped in place. read() returns false when
+// the stream ends before all products are read.
+template<typename Product>
+struct CProductSerializer {
+    static_assert(std::is_trivially_copyable<Product>::value, "CProductSerializer needs a specialization");
+
+    static void write(std::ostream &out, const std::vector<Product> &products) {
+        out.write(reinterpret_cast<const char *>(products.data()), std::streamsize(products.size() * sizeof(Product)));
+    }
+
+    static bool read(std::istream &in, std::vector<Product> &products, size_t count) {
+        products.clear();
+        while (products.size() < count) {
+            size_t from = products.size();
+            products.resize(from + std::min<size_t>(count - from, SAVE_READ_CHUNK));
+            if (!in.read(reinterpret_cast<char *>(products.data() + from),
+                         std::streamsize((products.size() - from) * sizeof(Product))))
+                return false;
+        }
+        return true;
+    }
+};
+
+// Strings are stored as their length followed by their characters
+template<>
+struct CProductSerializer<std::string> {
+    static void write(std::ostream &out, const std::vector<std::string> &products) {
+        for (const auto &product: products) {
+            uint64_t length = product.size();
+            out.write(reinterpret_cast<const char *>(&length), sizeof(length));
+            out.write(product.data(), std::streamsize(length));
+        }
+    }
+
+    static bool read(std::istream &in, std::vector<std::string> &products, size_t count) {
+        products.clear();
+        for (size_t i = 0; i < count; i++) {
+            uint64_t length = 0;
+            if (!in.read(reinterpret_cast<char *>(&length), sizeof(length)))
+                return false;
+            std::string product;
+            while (product.size() < length) {
+                size_t from = product.size();
+                product.resize(from + std::min<uint64_t>(length - from, SAVE_READ_CHUNK));
+                if (!in.read(&product[from], std::streamsize(product.size() - from)))
+                    return false;
+            }
+            products.push_back(std::move(product));
+        }
+        return true;
+    }
 };
 
+// Tags selecting the index structure behind Bestsellers
+struct CAvlBackend {};
+struct CBTreeBackend {};
+
+template<typename Product, typename Backend = CAvlBackend>
+struct Bestsellers;
+
 // Structure representing the Bestsellers management system using an AVL tree
 template<typename Product>
-struct Bestsellers {
-    Bestsellers() : root(nullptr) {}
+struct Bestsellers<Product, CAvlBackend> {
+    Bestsellers() : root(NIL_NODE) {}
 
-    std::unordered_map<Product, size_t> product_mapping; // Mapping from product to its amount
-    std::shared_ptr<CNode<Product>> root; // Root of the AVL tree
+    std::unordered_map<Product, CProductEntry> product_mapping; // Mapping from product to its amount and slot
+    CNodePool<Product> pool; // Storage of the AVL tree nodes
+    uint32_t root; // Index of the root of the AVL tree
 
     /**
      * Function to get the maximum of two size_t values.
@@ -56,79 +282,90 @@ struct Bestsellers {
 
     /**
      * Function to get the size of the products vector in a node.
-     * @param node Pointer to the node
+     * @param node Index of the node
      * @return Size of the products vector
      */
-    size_t getProductsSize(const std::shared_ptr<CNode<Product>> &node) const {
-        if (node == nullptr)
+    size_t getProductsSize(uint32_t node) const {
+        if (node == NIL_NODE)
             return 0;
-        return node->products.size();
+        return pool[node].products.size();
     }
 
     /**
      * Function to get the height of a node in the AVL tree.
-     * @param node Pointer to the node
+     * @param node Index of the node
      * @return Height of the node
      */
-    size_t getHeight(const std::shared_ptr<CNode<Product>> &node) const {
-        if (node == nullptr)
+    size_t getHeight(uint32_t node) const {
+        if (node == NIL_NODE)
             return 0;
-        return node->height;
+        return pool[node].height;
     }
 
     /**
      * Function to get the total product count in the child nodes of a node.
-     * @param node Pointer to the node
+     * @param node Index of the node
      * @return Total product count in the child nodes
      */
-    size_t getChildrenProductCnt(const std::shared_ptr<CNode<Product>> &node) const {
-        if (node == nullptr)
+    size_t getChildrenProductCnt(uint32_t node) const {
+        if (node == NIL_NODE)
             return 0;
-        return node->children_product_cnt + (node->products.size() * node->amount);
+        return pool[node].children_product_cnt + (pool[node].products.size() * pool[node].amount);
     }
 
     /**
      * Function to get the balance factor (alpha) of a node in the AVL tree.
-     * @param node Pointer to the node
+     * @param node Index of the node
      * @return Balance factor (height difference between left and right children)
      */
-    int getAlpha(const std::shared_ptr<CNode<Product>> &node) const {
-        if (node == nullptr)
+    int getAlpha(uint32_t node) const {
+        if (node == NIL_NODE)
             return 0;
-        return getHeight(node->right) - getHeight(node->left);
+        return (int) getHeight(pool[node].right) - (int) getHeight(pool[node].left);
     }
 
     /**
      * Function to get the total number of child nodes for a given node.
-     * @param node Pointer to the node
+     * @param node Index of the node
      * @return Total number of child nodes including the node itself
      */
-    size_t getChildren(const std::shared_ptr<CNode<Product>> &node) const {
-        if (node == nullptr)
+    size_t getChildren(uint32_t node) const {
+        if (node == NIL_NODE)
             return 0;
-        return node->children_cnt + 1; // +1 because we need to count the node itself
+        return pool[node].children_cnt + 1; // +1 because we need to count the node itself
     }
 
     /**
      * Function to get the total number of child nodes in both the left and right subtrees.
-     * @param node Pointer to the node
+     * @param node Index of the node
      * @return Total number of child nodes in both subtrees
      */
-    size_t getBothChildren(const std::shared_ptr<CNode<Product>> &node) const {
-        if (node == nullptr)
+    size_t getBothChildren(uint32_t node) const {
+        if (node == NIL_NODE)
             return 0;
-        return getChildren(node->left) + getChildren(node->right);
+        return getChildren(pool[node].left) + getChildren(pool[node].right);
+    }
+
+    /**
+     * Function to recompute the height and the child counters of a node from its children.
+     * @param node Index of the node
+     */
+    void updateNode(uint32_t node) {
+        CNode<Product> &n = pool[node];
+        n.height = (uint32_t) getMax(getHeight(n.left), getHeight(n.right)) + 1;
+        n.children_cnt = getBothChildren(node) + n.products.size() - 1;
+        n.children_product_cnt = getChildrenProductCnt(n.left) + getChildrenProductCnt(n.right);
     }
 
     /**
      * Function to find the inorder successor of a node in the AVL tree.
-     * @param node Pointer to the node
-     * @return Pointer to the inorder successor node
+     * @param node Index of the node
+     * @return Index of the inorder successor node
      */
-    std::shared_ptr<CNode<Product>> findInorderSuccessor(const std::shared_ptr<CNode<Product>> &node) {
-        std::shared_ptr<CNode<Product>> tmp = node;
-        while (tmp->left != nullptr)
-            tmp = tmp->left;
+    uint32_t findInorderSuccessor(uint32_t node) const {
+        uint32_t tmp = node;
+        while (pool[tmp].left != NIL_NODE)
+            tmp = pool[tmp].left;
         return tmp;
     }
 
@@ -136,200 +373,233 @@ struct Bestsellers {
      * Function to create a new node in the AVL tree.
      * @param product The product to store in the node
      * @param amount The amount of the product
-     * @return Pointer to the newly created node
-     */
-    std::shared_ptr<CNode<Product>> newNode(Product product, size_t amount) {
-        std::shared_ptr<CNode<Product>> node = std::make_shared<CNode<Product>>();
-        node->height = 1;
-        node->products.push_back(product);
-        node->amount = amount;
-        node->children_cnt = 0;
-        node->children_product_cnt = 0;
-        node->right = nullptr;
-        node->left = nullptr;
+     * @return Index of the newly created node
+     */
+    uint32_t newNode(const Product &product, size_t amount) {
+        uint32_t node = pool.allocate();
+        CNode<Product> &n = pool[node];
+        n.height = 1;
+        n.products.push_back(product);
+        n.amount = amount;
+        n.children_cnt = 0;
+        n.children_product_cnt = 0;
+        n.right = NIL_NODE;
+        n.left = NIL_NODE;
         return node;
     }
 
     /**
      * Function to perform a right rotation in the AVL tree.
-     * @param node Pointer to the node to rotate
-     * @return Pointer to the new root after rotation
+     * @param node Index of the node to rotate
+     * @return Index of the new root after rotation
      */
-    std::shared_ptr<CNode<Product>> rightRotate(const std::shared_ptr<CNode<Product>> &node) {
-        std::shared_ptr<CNode<Product>> node_left = node->left;
-        std::shared_ptr<CNode<Product>> node_left_right = node_left->right;
-
-        node_left->right = node;
-        node->left = node_left_right;
+    uint32_t rightRotate(uint32_t node) {
+        BESTSELLERS_COUNT(rotations);
+        uint32_t node_left = pool[node].left;
+        uint32_t node_left_right = pool[node_left].right;
 
-        node->height = getMax(getHeight(node->left), getHeight(node->right)) + 1;
-        node_left->height = getMax(getHeight(node_left->left), getHeight(node_left->right)) + 1;
+        pool[node_left].right = node;
+        pool[node].left = node_left_right;
 
-        node->children_cnt = getBothChildren(node) + node->products.size() - 1;
-        node_left->children_cnt = getBothChildren(node_left) + node_left->products.size() - 1;
-
-        node->children_product_cnt = getChildrenProductCnt(node->left) + getChildrenProductCnt(node->right);
-        node_left->children_product_cnt = getChildrenProductCnt(node_left->left) + getChildrenProductCnt(node_left->right);
+        updateNode(node);
+        updateNode(node_left);
 
         return node_left; // Return the new root after rotation
     }
 
     /**
      * Function to perform a left rotation in the AVL tree.
-     * @param node Pointer to the node to rotate
-     * @return Pointer to the new root after rotation
+     * @param node Index of the node to rotate
+     * @return Index of the new root after rotation
      */
-    std::shared_ptr<CNode<Product>> leftRotate(const std::shared_ptr<CNode<Product>> &node) {
-        std::shared_ptr<CNode<Product>> node_right = node->right;
-        std::shared_ptr<CNode<Product>> node_right_left = node_right->left;
-
-        node_right->left = node;
-        node->right = node_right_left;
+    uint32_t leftRotate(uint32_t node) {
+        BESTSELLERS_COUNT(rotations);
+        uint32_t node_right = pool[node].right;
+        uint32_t node_right_left = pool[node_right].left;
 
-        node->height = getMax(getHeight(node->left), getHeight(node->right)) + 1;
-        node_right->height = getMax(getHeight(node_right->left), getHeight(node_right->right)) + 1;
+        pool[node_right].left = node;
+        pool[node].right = node_right_left;
 
-        node->children_cnt = getBothChildren(node) + node->products.size() - 1;
-        node_right->children_cnt = getBothChildren(node_right) + node_right->products.size() - 1;
-
-        node->children_product_cnt = getChildrenProductCnt(node->left) + getChildrenProductCnt(node->right);
-        node_right->children_product_cnt = getChildrenProductCnt(node_right->left) + getChildrenProductCnt(node_right->right);
+        updateNode(node);
+        updateNode(node_right);
 
         return node_right; // Return the new root after rotation
     }
 
     /**
-     * Function to insert a new node into the AVL tree.
-     * @param node Pointer to the current node in the AVL tree
-     * @param product The product to insert
-     * @param amount The amount of the product
-     * @return Pointer to the updated node after insertion
+     * Function to restore the AVL balance of a node whose subtree has changed.
+     * @param node Index of the node
+     * @return Index of the new root of the subtree
      */
-    std::shared_ptr<CNode<Product>> insertNode(std::shared_ptr<CNode<Product>> &node, const Product &product, size_t amount) {
-        // Base case: if the node is null, create a new node
-        if (node == nullptr) {
-            product_mapping.emplace(product, amount);
-            return newNode(product, amount);
-        }
-
-        // Insert the product based on the amount
-        if (amount > node->amount)
-            node->right = insertNode(node->right, product, amount);
-        else if (amount < node->amount)
-            node->left = insertNode(node->left, product, amount);
-        else { // If the amount is equal, handle the product in the current node
-            auto it = std::find(node->products.begin(), node->products.end(), product);
-            if (it == node->products.end()) {
-                product_mapping.emplace(product, amount);
-                node->products.push_back(product);
-                node->children_cnt++;
-            } else {
-                node->products.erase(it);
-            }
-        }
-
-        // Update the height and child counts
-        node->height = getMax(getHeight(node->left), getHeight(node->right)) + 1;
-        node->children_cnt = getBothChildren(node) + node->products.size() - 1;
-        node->children_product_cnt = getChildrenProductCnt(node->left) + getChildrenProductCnt(node->right);
+    uint32_t rebalance(uint32_t node) {
+        // Update height and child counts
+        updateNode(node);
 
         // Check and correct AVL tree balance
         int avl_balance = getAlpha(node);
 
-        if (avl_balance < -1 && node->left->amount > amount)
+        if (avl_balance < -1 && (getAlpha(pool[node].left) <= 0))
             return rightRotate(node);
-        else if (avl_balance < -1 && node->left->amount < amount) {
-            node->left = leftRotate(node->left);
+        else if (avl_balance < -1 && (getAlpha(pool[node].left) > 0)) {
+            pool[node].left = leftRotate(pool[node].left);
             return rightRotate(node);
         }
-        else if (avl_balance > 1 && node->right->amount < amount)
+        else if (avl_balance > 1 && (getAlpha(pool[node].right) >= 0))
             return leftRotate(node);
-        else if (avl_balance > 1 && node->right->amount > amount) {
-            node->right = rightRotate(node->right);
+        else if (avl_balance > 1 && (getAlpha(pool[node].right) < 0)) {
+            pool[node].right = rightRotate(pool[node].right);
             return leftRotate(node);
         }
         return node;
     }
 
+    /**
+     * Function to append a product to the bucket of its amount, creating the node if there is none.
+     * @param node Index of the current node in the AVL tree
+     * @param product The product to insert
+     * @param entry Mapping entry of the product, its amount selects the bucket and its slot is filled in
+     * @return Index of the updated node after insertion
+     */
+    uint32_t insertNode(uint32_t node, const Product &product, CProductEntry &entry) {
+        // Base case: if the node is null, create a new node
+        if (node == NIL_NODE) {
+            entry.slot = 0;
+            return newNode(product, entry.amount);
+        }
+
+        // Insert the product based on the amount (the pool may grow, so no references are kept across the call)
+        if (entry.amount > pool[node].amount) {
+            uint32_t right = insertNode(pool[node].right, product, entry);
+            pool[node].right = right;
+        } else if (entry.amount < pool[node].amount) {
+            uint32_t left = insertNode(pool[node].left, product, entry);
+            pool[node].left = left;
+        } else { // If the amount is equal, the product joins the bucket of the current node
+            entry.slot = (uint32_t) pool[node].products.size();
+            pool[node].products.push_back(product);
+            updateNode(node);
+            return node; // The shape of the tree did not change
+        }
+
+        return rebalance(node);
+    }
+
     /**
      * Function to delete a node from the AVL tree.
-     * @param node Pointer to the current node in the AVL tree
-     * @param product The product to delete
-     * @param amount The amount of the product
-     * @param delete_full Flag to indicate whether to delete the full node
-     * @param delete_containers Flag to indicate whether to delete the container of products
-     * @return Pointer to the updated node after deletion
-     */
-    std::shared_ptr<CNode<Product>> deleteNode(std::shared_ptr<CNode<Product>> &node, Product product, size_t amount, bool delete_full,
-                                               bool delete_containers) {
-        // If the tree is empty or the product is not found
-        if (node == nullptr)
+     * Removed nodes go back to the free list of the pool.
+     * @param node Index of the current node in the AVL tree
+     * @param amount The amount of the node to delete
+     * @return Index of the updated node after deletion
+     */
+    uint32_t deleteNode(uint32_t node, size_t amount) {
+        // If the tree is empty or the amount is not found
+        if (node == NIL_NODE)
             return node;
 
         // Recursive call to find the node to delete
-        if (amount > node->amount)
-            node->right = deleteNode(node->right, product, amount, delete_full, delete_containers);
-        else if (amount < node->amount)
-            node->left = deleteNode(node->left, product, amount, delete_full, delete_containers);
-        else { // If the node is found
-            if (node->products.size() == 1 || delete_full) {
-                if (node->right == nullptr && node->left == nullptr) { // No children
-                    for (const auto &item: node->products)
-                        if (delete_containers)
-                            product_mapping.erase(item);
-                    node = nullptr;
-                    return node;
-                }
-                else if (node->right == nullptr) { // One left child
-                    for (const auto &item: node->products)
-                        if (delete_containers)
-                            product_mapping.erase(item);
-                    std::shared_ptr<CNode<Product>> tmp = node->left;
-                    *node = *tmp;
-                } else if (node->left == nullptr) { // One right child
-                    for (const auto &item: node->products)
-                        if (delete_containers)
-                            product_mapping.erase(item);
-                    std::shared_ptr<CNode<Product>> tmp = node->right;
-                    *node = *tmp;
-                } else { // Two children, find inorder successor
-                    for (const auto &item: node->products)
-                        if (delete_containers)
-                            product_mapping.erase(item);
-                    std::shared_ptr<CNode<Product>> inorder_successor = findInorderSuccessor(node->right);
-                    node->amount = inorder_successor->amount;
-                    node->products = inorder_successor->products;
-                    node->right = deleteNode(node->right, *inorder_successor->products.begin(),
-                                             node->amount, true, false);
-                }
-            } else { // Handle partial deletion in the node
-                node->products.erase(std::find(node->products.begin(), node->products.end(), product));
-                if (delete_containers)
-                    product_mapping.erase(product);
+        if (amount > pool[node].amount) {
+            uint32_t right = deleteNode(pool[node].right, amount);
+            pool[node].right = right;
+        } else if (amount < pool[node].amount) {
+            uint32_t left = deleteNode(pool[node].left, amount);
+            pool[node].left = left;
+        } else { // If the node is found
+            CNode<Product> &n = pool[node];
+            if (n.right == NIL_NODE || n.left == NIL_NODE) { // At most one child takes the place of the node
+                uint32_t child = n.right == NIL_NODE ? n.left : n.right;
+                pool.release(node);
+                return child;
+            } else { // Two children, the inorder successor moves here with its bucket (slots stay valid)
+                uint32_t inorder_successor = findInorderSuccessor(n.right);
+                n.amount = pool[inorder_successor].amount;
+                n.products.swap(pool[inorder_successor].products);
+                uint32_t right = deleteNode(n.right, n.amount);
+                pool[node].right = right;
             }
         }
 
-        // Update height and child counts
-        node->height = getMax(getHeight(node->left), getHeight(node->right)) + 1;
-        node->children_cnt = getBothChildren(node) + node->products.size() - 1;
-        node->children_product_cnt = getChildrenProductCnt(node->left) + getChildrenProductCnt(node->right);
+        return rebalance(node);
+    }
 
-        // Check and correct AVL tree balance
-        int avl_balance = getAlpha(node);
+    /**
+     * Function to remove the product at the given slot of a bucket by moving the last product of the bucket
+     * into its place, the slot of the moved product is updated in the mapping.
+     * @param node Index of the node
+     * @param slot Slot of the product to remove
+     */
+    void eraseSlot(uint32_t node, uint32_t slot) {
+        std::vector<Product> &products = pool[node].products;
+        if (slot != products.size() - 1) {
+            products[slot] = std::move(products.back());
+            product_mapping.find(products[slot])->second.slot = slot;
+        }
+        products.pop_back();
+    }
 
-        if (avl_balance < -1 && (getAlpha(node->left) <= 0))
-            return rightRotate(node);
-        else if (avl_balance < -1 && (getAlpha(node->left) > 0)) {
-            node->left = leftRotate(node->left);
-            return rightRotate(node);
+    /**
+     * Function to remove a product from the bucket of its amount in O(1) by swapping the last product of
+     * the bucket into its slot. The node itself is deleted when its bucket becomes empty.
+     * @param node Index of the current node in the AVL tree
+     * @param entry Mapping entry of the product to remove
+     * @return Index of the updated node after removal
+     */
+    uint32_t removeProduct(uint32_t node, const CProductEntry &entry) {
+        if (entry.amount > pool[node].amount) {
+            uint32_t right = removeProduct(pool[node].right, entry);
+            pool[node].right = right;
+        } else if (entry.amount < pool[node].amount) {
+            uint32_t left = removeProduct(pool[node].left, entry);
+            pool[node].left = left;
+        } else {
+            if (pool[node].products.size() == 1)
+                return deleteNode(node, entry.amount);
+            eraseSlot(node, entry.slot);
+            updateNode(node);
+            return node; // The shape of the tree did not change
         }
-        else if (avl_balance > 1 && (getAlpha(node->right) >= 0))
-            return leftRotate(node);
-        else if (avl_balance > 1 && (getAlpha(node->right) < 0)) {
-            node->right = rightRotate(node->right);
-            return leftRotate(node);
+
+        return rebalance(node);
+    }
+
+    /**
+     * Function to move a product from the bucket of its old amount to the bucket of a higher amount.
+     * The common part of both search paths is walked once and every node on the union of the two paths is
+     * rebalanced at most once on the way back up.
+     * @param node Index of the current node in the AVL tree
+     * @param product The product being moved
+     * @param entry Mapping entry of the product, holds the old amount and slot and receives the new slot
+     * @param new_amount The new amount of the product, greater than the old one
+     * @return Index of the updated node after the move
+     */
+    uint32_t moveProduct(uint32_t node, const Product &product, CProductEntry &entry, size_t new_amount) {
+        size_t old_amount = entry.amount;
+        if (old_amount > pool[node].amount) { // Both buckets are in the right subtree
+            uint32_t right = moveProduct(pool[node].right, product, entry, new_amount);
+            pool[node].right = right;
+        } else if (new_amount < pool[node].amount) { // Both buckets are in the left subtree
+            uint32_t left = moveProduct(pool[node].left, product, entry, new_amount);
+            pool[node].left = left;
+        } else { // The paths split here
+            CProductEntry old_entry = entry;
+            entry.amount = new_amount;
+            if (new_amount == pool[node].amount) {
+                entry.slot = (uint32_t) pool[node].products.size();
+                pool[node].products.push_back(product);
+            } else {
+                uint32_t right = insertNode(pool[node].right, product, entry);
+                pool[node].right = right;
+            }
+            if (old_amount == pool[node].amount) {
+                if (pool[node].products.size() == 1)
+                    return deleteNode(node, old_amount);
+                eraseSlot(node, old_entry.slot);
+            } else {
+                uint32_t left = removeProduct(pool[node].left, old_entry);
+                pool[node].left = left;
+            }
         }
-        return node;
+
+        return rebalance(node);
     }
 
     /**
@@ -346,17 +616,253 @@ struct Bestsellers {
      * @param amount The amount sold
      */
     void sell(const Product &p, size_t amount) {
-        if (product_mapping.count(p)) {
-            size_t tmp_amount = product_mapping.at(p);
-            root = deleteNode(root, p, product_mapping.at(p), false, true);
-            root = insertNode(root, p, amount + tmp_amount);
-        } else
-            root = insertNode(root, p, amount);
+        auto [it, inserted] = product_mapping.try_emplace(p, CProductEntry{amount, 0});
+        if (inserted)
+            root = insertNode(root, it->first, it->second);
+        else if (amount)
+            root = moveProduct(root, it->first, it->second, it->second.amount + amount);
+    }
+
+    /**
+     * Function to take back copies of a product, e.g. sales that left a time window or were refunded.
+     * A product whose amount drops to 0 is no longer tracked.
+     * @param p The product
+     * @param amount The amount to take back, at most the amount the product has sold
+     */
+    void withdraw(const Product &p, size_t amount) {
+        auto it = product_mapping.find(p);
+        if (it == product_mapping.end())
+            throw std::out_of_range("there is no product with such a name");
+        if (amount > it->second.amount)
+            throw std::out_of_range("you cant do this");
+        if (!amount)
+            return;
+        root = removeProduct(root, it->second);
+        if (amount == it->second.amount) {
+            product_mapping.erase(it);
+            return;
+        }
+        it->second.amount -= amount;
+        root = insertNode(root, it->first, it->second);
+    }
+
+    /**
+     * Function to record a batch of sales at once. Sales of the same product are summed up directly in its
+     * entry of the product mapping, so every sale costs a single hash lookup. The net changes are then either
+     * applied one by one, or, when the batch touches a large part of the tree, the tree is rebuilt in one pass
+     * by merging the untouched products (already sorted by the tree) with the touched ones sorted by their new
+     * amount.
+     * @param sales Range of (product, amount) pairs
+     */
+    template<typename Range>
+    void sellBatch(const Range &sales) {
+        using Item = typename std::unordered_map<Product, CProductEntry>::value_type;
+
+        // The first sale of a product in the batch remembers its old amount, the slot of a product already in
+        // the tree is flagged meanwhile, products seen for the first time are not in the tree yet
+        std::vector<std::pair<Item *, size_t>> touched;
+        for (const auto &sale: sales) {
+            auto [it, inserted] = product_mapping.try_emplace(sale.first, CProductEntry{0, NIL_SLOT});
+            CProductEntry &entry = it->second;
+            if (inserted)
+                touched.emplace_back(&*it, 0);
+            else if (entry.slot != NIL_SLOT && !(entry.slot & PENDING_SLOT)) {
+                touched.emplace_back(&*it, entry.amount);
+                entry.slot |= PENDING_SLOT;
+            }
+            entry.amount += sale.second;
+        }
+
+        // A rebuild visits every product once, an update walks a path and moves the product between buckets
+        if (touched.size() * BATCH_REBUILD_RATIO < product_mapping.size()) {
+            for (const auto &[item, old_amount]: touched) {
+                CProductEntry &entry = item->second;
+                if (entry.slot == NIL_SLOT) {
+                    root = insertNode(root, item->first, entry);
+                    continue;
+                }
+                entry.slot &= ~PENDING_SLOT;
+                size_t new_amount = entry.amount;
+                if (new_amount == old_amount)
+                    continue;
+                entry.amount = old_amount;
+                root = moveProduct(root, item->first, entry, new_amount);
+            }
+            return;
+        }
+
+        // Products whose amount changes, sorted by their new amount, the flagged slots are all rewritten below
+        size_t changed = 0;
+        for (const auto &[item, old_amount]: touched)
+            if (item->second.slot == NIL_SLOT || item->second.amount != old_amount)
+                touched[changed++].first = item;
+        touched.resize(changed);
+        std::sort(touched.begin(), touched.end(), [](const auto &a, const auto &b) {
+            return a.first->second.amount < b.first->second.amount;
+        });
+
+        std::vector<std::pair<size_t, std::vector<Product>>> buckets;
+        auto emit = [&buckets](Product &&product, CProductEntry &entry) {
+            if (buckets.empty() || buckets.back().first != entry.amount)
+                buckets.emplace_back(entry.amount, std::vector<Product>());
+            entry.slot = (uint32_t) buckets.back().second.size();
+            buckets.back().second.push_back(std::move(product));
+        };
+
+        // Merge the in-order walk of the tree with the touched products, untouched products are the ones whose
+        // amount in the mapping still matches their node
+        auto next_touched = touched.begin();
+        std::vector<uint32_t> stack;
+        uint32_t node = root;
+        while (node != NIL_NODE || !stack.empty()) {
+            for (; node != NIL_NODE; node = pool[node].left)
+                stack.push_back(node);
+            node = stack.back();
+            stack.pop_back();
+            size_t amount = pool[node].amount;
+            for (; next_touched != touched.end() && next_touched->first->second.amount <= amount; ++next_touched)
+                emit(Product(next_touched->first->first), next_touched->first->second);
+            for (auto &product: pool[node].products) {
+                CProductEntry &entry = product_mapping.find(product)->second;
+                if (entry.amount == amount)
+                    emit(std::move(product), entry);
+            }
+            node = pool[node].right;
+        }
+        for (; next_touched != touched.end(); ++next_touched)
+            emit(Product(next_touched->first->first), next_touched->first->second);
+
+        buildFromBuckets(buckets);
+    }
+
+    /**
+     * Function to replace the tree by a perfectly balanced one built from buckets sorted by amount in O(n).
+     * The mapping must already hold the amounts of all products and their slots within the buckets.
+     * @param buckets Pairs of an amount and the products sold that many times, in ascending order of amount
+     */
+    void buildFromBuckets(std::vector<std::pair<size_t, std::vector<Product>>> &buckets) {
+        pool.nodes.clear();
+        pool.free_head = NIL_NODE;
+        pool.live = 0;
+        pool.reserve(buckets.size());
+        root = buildSubtree(buckets, 0, buckets.size());
+    }
+
+    /**
+     * Helper function to build a balanced subtree from a range of sorted buckets.
+     * @param buckets Buckets sorted by amount
+     * @param from First bucket of the range
+     * @param to One past the last bucket of the range
+     * @return Index of the root of the subtree
+     */
+    uint32_t buildSubtree(std::vector<std::pair<size_t, std::vector<Product>>> &buckets, size_t from, size_t to) {
+        if (from >= to)
+            return NIL_NODE;
+        size_t mid = from + (to - from) / 2;
+        uint32_t left = buildSubtree(buckets, from, mid);
+        uint32_t right = buildSubtree(buckets, mid + 1, to);
+        uint32_t node = pool.allocate();
+        CNode<Product> &n = pool[node];
+        n.left = left;
+        n.right = right;
+        n.amount = buckets[mid].first;
+        n.products = std::move(buckets[mid].second);
+        updateNode(node);
+        return node;
+    }
+
+    /**
+     * Function to write all products and their amounts to a stream in a compact binary format.
+     * The header holds the magic number, the version, the number of buckets and the number of products, then every
+     * bucket follows in ascending order of amount as its amount, its size and its products encoded by
+     * CProductSerializer.
+     * @param out The stream to write to
+     */
+    void save(std::ostream &out) const {
+        uint32_t header[2] = {SAVE_MAGIC, SAVE_VERSION};
+        uint64_t counts[2] = {pool.live, product_mapping.size()};
+        out.write(reinterpret_cast<const char *>(header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(counts), sizeof(counts));
+
+        std::vector<uint32_t> stack;
+        uint32_t node = root;
+        while (node != NIL_NODE || !stack.empty()) {
+            for (; node != NIL_NODE; node = pool[node].left)
+                stack.push_back(node);
+            node = stack.back();
+            stack.pop_back();
+            uint64_t bucket[2] = {pool[node].amount, pool[node].products.size()};
+            out.write(reinterpret_cast<const char *>(bucket), sizeof(bucket));
+            CProductSerializer<Product>::write(out, pool[node].products);
+            node = pool[node].right;
+        }
+    }
+
+    /**
+     * Function to replace the tracked products by the ones written by save().
+     * The tree is built from the sorted buckets in O(n) without any rotations. If the data are not valid,
+     * std::invalid_argument is thrown and the tracker is left unchanged.
+     * @param in The stream to read from
+     */
+    void load(std::istream &in) {
+        uint32_t header[2] = {0, 0};
+        uint64_t counts[2] = {0, 0};
+        in.read(reinterpret_cast<char *>(header), sizeof(header));
+        in.read(reinterpret_cast<char *>(counts), sizeof(counts));
+        if (!in || header[0] != SAVE_MAGIC || header[1] != SAVE_VERSION || counts[0] >= NIL_NODE ||
+            counts[0] > counts[1])
+            throw std::invalid_argument("this is not a saved bestsellers");
+
+        std::unordered_map<Product, CProductEntry> mapping;
+        std::vector<std::pair<size_t, std::vector<Product>>> buckets;
+        mapping.reserve(std::min<uint64_t>(counts[1], SAVE_READ_CHUNK));
+        buckets.reserve(std::min<uint64_t>(counts[0], SAVE_READ_CHUNK));
+        for (uint64_t i = 0; i < counts[0]; i++) {
+            uint64_t bucket[2] = {0, 0};
+            if (!in.read(reinterpret_cast<char *>(bucket), sizeof(bucket)) || !bucket[1] || bucket[1] >= PENDING_SLOT ||
+                (!buckets.empty() && buckets.back().first >= bucket[0]))
+                throw std::invalid_argument("saved bestsellers are corrupted");
+            buckets.emplace_back(bucket[0], std::vector<Product>());
+            if (!CProductSerializer<Product>::read(in, buckets.back().second, bucket[1]))
+                throw std::invalid_argument("saved bestsellers are corrupted");
+            for (uint32_t slot = 0; slot < bucket[1]; slot++)
+                if (!mapping.emplace(buckets.back().second[slot], CProductEntry{bucket[0], slot}).second)
+                    throw std::invalid_argument("saved bestsellers are corrupted");
+        }
+        if (mapping.size() != counts[1])
+            throw std::invalid_argument("saved bestsellers are corrupted");
+
+        product_mapping.swap(mapping);
+        buildFromBuckets(buckets);
+    }
+
+    /**
+     * Function to replace the tracked products by the given ones in O(n), e.g. when importing from a database.
+     * Products with the same amount get ranks in the order in which they are given.
+     * @param sorted Range of (product, amount) pairs in ascending order of amount, every product at most once
+     */
+    template<typename Range>
+    void bulkLoad(const Range &sorted) {
+        std::unordered_map<Product, CProductEntry> mapping;
+        std::vector<std::pair<size_t, std::vector<Product>>> buckets;
+        for (const auto &[product, amount]: sorted) {
+            if (!buckets.empty() && buckets.back().first > amount)
+                throw std::invalid_argument("products are not sorted");
+            if (buckets.empty() || buckets.back().first != amount)
+                buckets.emplace_back(amount, std::vector<Product>());
+            uint32_t slot = (uint32_t) buckets.back().second.size();
+            if (!mapping.emplace(product, CProductEntry{(size_t) amount, slot}).second)
+                throw std::invalid_argument("product is there twice");
+            buckets.back().second.push_back(product);
+        }
+
+        product_mapping.swap(mapping);
+        buildFromBuckets(buckets);
     }
 
     /**
      * Function to get the rank of a product based on its sales amount.
-     * @param node Pointer to the current node in the AVL tree
+     * @param node Index of the current node in the AVL tree
      * @param p The product to find the rank for
      * @param amount The amount of the product
      * @param max_rank Reference to store the maximum rank
@@ -364,30 +870,25 @@ struct Bestsellers {
      * @param found_same Reference to store the rank if the product is found
      * @return The rank of the product
      */
-    size_t getRank(const std::shared_ptr<CNode<Product>> &node, const Product &p, const size_t &amount,
+    size_t getRank(uint32_t node, const Product &p, const size_t &amount,
                    size_t &max_rank, std::string find_same, size_t &found_same) const {
-        if (node == nullptr)
+        if (node == NIL_NODE)
             throw std::out_of_range("blabla");
-        if (amount > node->amount) {
-            getRank(node->right, p, amount, max_rank, find_same, found_same);
-        } else if (amount < node->amount) {
-            max_rank += getChildren(node->right) + getProductsSize(node);
-            getRank(node->left, p, amount, max_rank, find_same, found_same);
-        } else if (amount == node->amount) {
+        if (amount > pool[node].amount) {
+            getRank(pool[node].right, p, amount, max_rank, find_same, found_same);
+        } else if (amount < pool[node].amount) {
+            max_rank += getChildren(pool[node].right) + getProductsSize(node);
+            getRank(pool[node].left, p, amount, max_rank, find_same, found_same);
+        } else if (amount == pool[node].amount) {
+            size_t right_child_count = getChildren(pool[node].right);
             if (find_same == "first_same") {
-                found_same = max_rank + 1;
+                found_same = max_rank + right_child_count + 1;
                 return 1;
             } else if (find_same == "last_same") {
-                found_same = max_rank + getProductsSize(node);
+                found_same = max_rank + right_child_count + getProductsSize(node);
                 return 1;
             }
-            int right_child_count = node->right ? getChildren(node->right) : 0;
-            for (size_t i = 0; i < getProductsSize(node); i++) {
-                if (node->products[i] == p) {
-                    max_rank += i + 1 + right_child_count;
-                    return max_rank;
-                }
-            }
+            max_rank += product_mapping.at(p).slot + 1 + right_child_count;
         }
         return max_rank;
     }
@@ -401,9 +902,7 @@ struct Bestsellers {
     size_t rank(const Product &p) const {
         if (!product_mapping.count(p))
             throw std::out_of_range("there is no product with such a name");
-        size_t product_amount = 0;
-        if (product_mapping.count(p))
-            product_amount = product_mapping.at(p);
+        size_t product_amount = product_mapping.at(p).amount;
         size_t max_rank = 0;
         size_t rubbish_amount;
         getRank(root, p, product_amount, max_rank, "nothing", rubbish_amount);
@@ -411,56 +910,66 @@ struct Bestsellers {
     }
 
     /**
-     * Helper function to retrieve the product at a given rank.
-     * @param node Pointer to the current node in the AVL tree
-     * @param rank The rank to retrieve
-     * @param product_return Reference to store the product found
-     * @param aggregate_children Reference to store the aggregate number of children
-     * @param aggregate_product The product to aggregate
-     * @return The product at the given rank
+     * Helper function to find the node holding the product at a given rank.
+     * @param rank The rank to find, must be valid
+     * @param offset Reference to store the position of the product in the products vector of the node
+     * @return Index of the node
      */
-    Product & getProduct(const std::shared_ptr<CNode<Product>> &node, size_t &rank, Product &product_return,
-                         size_t &aggregate_children, const Product &aggregate_product) const {
-        size_t right_children = getChildren(node->right);
-        if (rank <= right_children)
-            product_return = getProduct(node->right, rank, product_return, aggregate_children, aggregate_product);
-        else if (rank > right_children) {
-            if (rank <= right_children + getProductsSize(node)) {
-                int iterate_to = rank - right_children;
-                aggregate_children += getChildrenProductCnt(node->right);
-                for (size_t i = 0; i < getProductsSize(node); i++) {
-                    if (node->products[i] == aggregate_product)
-                        aggregate_children += node->amount * (i + 1);
-                }
-                size_t cnt = 0;
-                for (int i = 0; i < iterate_to; i++) {
-                    product_return = node->products[i];
-                    cnt = i;
-                }
-                return node->products[cnt];
-            } else {
-                size_t new_rank = rank - right_children - getProductsSize(node);
-                aggregate_children += getChildrenProductCnt(node->right) + getProductsSize(node) * node->amount;
-                product_return = getProduct(node->left, new_rank, product_return, aggregate_children,
-                                            aggregate_product);
+    uint32_t findRank(size_t rank, size_t &offset) const {
+        uint32_t node = root;
+        while (true) {
+            size_t right_children = getChildren(pool[node].right);
+            if (rank <= right_children) {
+                node = pool[node].right;
+                continue;
+            }
+            rank -= right_children;
+            if (rank <= getProductsSize(node)) {
+                offset = rank - 1;
+                return node;
             }
+            rank -= getProductsSize(node);
+            node = pool[node].left;
         }
-        return product_return;
+    }
+
+    /**
+     * Helper function to sum up the copies sold by the products with the highest ranks of a subtree.
+     * @param node Index of the root of the subtree
+     * @param rank Number of products to sum up, ranks are counted within the subtree
+     * @return The total number of copies sold by the first rank products
+     */
+    size_t soldPrefix(uint32_t node, size_t rank) const {
+        size_t sum = 0;
+        while (rank && node != NIL_NODE) {
+            size_t right_children = getChildren(pool[node].right);
+            if (rank <= right_children) {
+                node = pool[node].right;
+                continue;
+            }
+            sum += getChildrenProductCnt(pool[node].right);
+            rank -= right_children;
+            if (rank <= getProductsSize(node))
+                return sum + rank * pool[node].amount;
+            sum += getProductsSize(node) * pool[node].amount;
+            rank -= getProductsSize(node);
+            node = pool[node].left;
+        }
+        return sum;
     }
 
     /**
      * Function to get the product at a specific rank.
+     * The reference stays valid until the next sale.
      * @param rank The rank to retrieve
      * @return The product at the given rank
      */
     const Product &product(size_t rank) const {
         if (rank > product_mapping.size() || rank < 1)
             throw std::out_of_range("rank is incorrect");
-        static Product product1;
-        size_t aggregate_children = 0;
-        Product rubbish;
-        product1 = getProduct(root, rank, product1, aggregate_children, rubbish);
-        return product1;
+        size_t offset;
+        uint32_t node = findRank(rank, offset);
+        return pool[node].products[offset];
     }
 
     /**
@@ -471,12 +980,14 @@ struct Bestsellers {
     size_t sold(size_t rank) const {
         if (rank > product_mapping.size() || rank < 1)
             throw std::out_of_range("rank is incorrect");
-        Product tmp = product(rank);
-        return product_mapping.at(tmp);
+        size_t offset;
+        return pool[findRank(rank, offset)].amount;
     }
 
     /**
      * Function to get the total number of copies sold for products within a rank range.
+     * The descent follows both ends of the range together until they split, then sums up the suffix of the
+     * right subtree and the prefix of the left subtree of the split node, visiting O(log n) nodes.
      * @param from The starting rank
      * @param to The ending rank
      * @return The total number of copies sold within the range
@@ -484,17 +995,82 @@ struct Bestsellers {
     size_t sold(size_t from, size_t to) const {
         if (from > to || from < 1 || to < 1 || from > product_mapping.size() || to > product_mapping.size())
             throw std::out_of_range("from is bigger than to");
-        if (from == to)
-            return sold(from);
 
-        Product p_from = product(from);
-        Product p_to = product(to);
-        size_t one_to_from = 0;
-        size_t one_to_to = 0;
-        Product rubbish;
-        getProduct(root, from, rubbish, one_to_from, p_from);
-        getProduct(root, to, rubbish, one_to_to, p_to);
-        return one_to_to - one_to_from + product_mapping.at(p_from);
+        uint32_t node = root;
+        while (true) {
+            uint32_t right = pool[node].right;
+            size_t right_children = getChildren(right);
+            size_t size = getProductsSize(node);
+            if (to <= right_children) { // The whole range is in the right subtree
+                node = right;
+                continue;
+            }
+            if (from > right_children + size) { // The whole range is in the left subtree
+                from -= right_children + size;
+                to -= right_children + size;
+                node = pool[node].left;
+                continue;
+            }
+
+            size_t sum = 0;
+            if (from <= right_children)
+                sum += getChildrenProductCnt(right) - soldPrefix(right, from - 1);
+            size_t bucket_from = std::max(from, right_children + 1);
+            size_t bucket_to = std::min(to, right_children + size);
+            sum += (bucket_to - bucket_from + 1) * pool[node].amount;
+            if (to > right_children + size)
+                sum += soldPrefix(pool[node].left, to - right_children - size);
+            return sum;
+        }
+    }
+
+    /**
+     * Function to get an iterator to the product with the best rank.
+     * @return Iterator at rank 1
+     */
+    CRankIterator<Product> begin() const {
+        return rankedFrom(1);
+    }
+
+    /**
+     * Function to get the iterator past the product with the worst rank.
+     * @return End iterator
+     */
+    CRankIterator<Product> end() const {
+        CRankIterator<Product> it;
+        it.pool = &pool;
+        return it;
+    }
+
+    /**
+     * Function to get an iterator starting at a given rank, the products with worse ranks follow.
+     * @param rank The first rank to visit, ranks past the last product give the end iterator
+     * @return Iterator at the given rank
+     */
+    CRankIterator<Product> rankedFrom(size_t rank) const {
+        if (rank < 1)
+            throw std::out_of_range("rank is incorrect");
+        CRankIterator<Product> it = end();
+        if (rank > product_mapping.size())
+            return it;
+        it.rank = rank;
+        uint32_t node = root;
+        while (true) {
+            size_t right_children = getChildren(pool[node].right);
+            if (rank <= right_children) {
+                it.stack.push_back(node); // Visited after the right subtree
+                node = pool[node].right;
+                continue;
+            }
+            rank -= right_children;
+            if (rank <= getProductsSize(node)) {
+                it.node = node;
+                it.offset = rank - 1;
+                return it;
+            }
+            rank -= getProductsSize(node);
+            node = pool[node].left;
+        }
     }
 
     /**
@@ -505,9 +1081,9 @@ struct Bestsellers {
     size_t firstSame(size_t r) const {
         if (r > product_mapping.size() || r < 1)
             throw std::out_of_range("you cant do this");
-        Product product1 = product(r);
+        const Product &product1 = product(r);
         size_t max_rank = 0;
-        size_t product1_amount = product_mapping.at(product1);
+        size_t product1_amount = product_mapping.at(product1).amount;
         size_t found_rank = 0;
         getRank(root, product1, product1_amount, max_rank, "first_same", found_rank);
         return found_rank;
@@ -521,53 +1097,1618 @@ struct Bestsellers {
     size_t lastSame(size_t r) const {
         if (r > product_mapping.size() || r < 1)
             throw std::out_of_range("you cant do this");
-        Product product1 = product(r);
+        const Product &product1 = product(r);
         size_t max_rank = 0;
-        size_t product1_amount = product_mapping.at(product1);
+        size_t product1_amount = product_mapping.at(product1).amount;
         size_t found_rank = 0;
         getRank(root, product1, product1_amount, max_rank, "last_same", found_rank);
         return found_rank;
     }
 
+    /**
+     * Function to count the products that sold more than, or at least, a given amount.
+     * @param amount The amount
+     * @param inclusive Whether products with exactly the given amount are counted
+     * @return The number of such products
+     */
+    size_t countAbove(size_t amount, bool inclusive) const {
+        size_t result = 0;
+        for (uint32_t node = root; node != NIL_NODE;) {
+            if (pool[node].amount > amount || (inclusive && pool[node].amount == amount)) {
+                result += getChildren(pool[node].right) + getProductsSize(node);
+                node = pool[node].left;
+            } else
+                node = pool[node].right;
+        }
+        return result;
+    }
+
+    /**
+     * Function to sum up the copies sold by the products that sold more than, or at least, a given amount.
+     * @param amount The amount
+     * @param inclusive Whether products with exactly the given amount are included
+     * @return The total number of copies sold by such products
+     */
+    size_t soldAbove(size_t amount, bool inclusive) const {
+        size_t result = 0;
+        for (uint32_t node = root; node != NIL_NODE;) {
+            if (pool[node].amount > amount || (inclusive && pool[node].amount == amount)) {
+                result += getChildrenProductCnt(pool[node].right) + getProductsSize(node) * pool[node].amount;
+                node = pool[node].left;
+            } else
+                node = pool[node].right;
+        }
+        return result;
+    }
+
 };
 
-#ifndef __PROGTEST__
+// Number of children of an inner node and of amounts in a leaf of the B+-tree backend, a leaf fills 4 cache lines
+constexpr uint32_t BTREE_FANOUT = 16;
 
-/**
- * Test case 1: Testing various functionalities of the Bestsellers class.
- */
-void test1() {
-    Bestsellers<std::string> T;
-    T.sell("coke", 32);
-    T.sell("bread", 1);
-    assert(T.products() == 2);
-    T.sell("ham", 2);
-    T.sell("mushrooms", 12);
-    T.sell("bla", 12);
-    T.sell("apple", 12);
-    T.sell("oi", 1);
-    T.sell("nanana", 1);
-    T.sell("kukuku", 1);
+// Inner node of the B+-tree backend
+struct CBTreeInner {
+    uint32_t size = 0; // Number of children
+    uint32_t children[BTREE_FANOUT]; // Indices of the children, leaves when the node is on the lowest inner level
+    size_t keys[BTREE_FANOUT]; // keys[i] is the smallest amount in child i, keys[0] is not used
+    size_t counts[BTREE_FANOUT]; // Number of products in the subtree of each child
+    size_t sums[BTREE_FANOUT]; // Total amount of the products in the subtree of each child
+};
 
-    assert(T.firstSame(2) == 2);
-    assert(T.lastSame(2) == 4);
-    assert(T.sold(2) == T.sold(4));
+// Leaf of the B+-tree backend, one entry per distinct amount
+struct CBTreeLeaf {
+    uint32_t size = 0; // Number of amounts
+    size_t amounts[BTREE_FANOUT]; // Amounts in ascending order
+    uint32_t buckets[BTREE_FANOUT]; // Bucket holding the products of each amount
+    uint32_t counts[BTREE_FANOUT]; // Number of products in each bucket, 0 for an amount nobody has any more
+};
 
-    assert(T.firstSame(7) == 6);
-    assert(T.lastSame(7) == 9);
-    assert(T.sold(7) == T.sold(6) == T.sold(8) == T.sold(9));
-}
+// Structure describing where a product is stored in the B+-tree backend
+struct CBTreeEntry {
+    size_t amount; // Amount of the product
+    uint32_t bucket; // Bucket holding the products with this amount
+    uint32_t slot; // Position of the product in the bucket
+};
 
-/**
- * Test case 2: Testing exceptions and error handling.
- */
-void test2() {
-# define CATCH(expr) \
-  try { expr; assert(0); } catch (const std::out_of_range&) { assert(1); };
+// Bestsellers backed by an order-statistic B+-tree over the distinct amounts. Nodes are wide and stored in
+// two arrays, so a query touches a few cache lines per level of a tree that is 4 times shallower than the AVL.
+// An amount whose bucket becomes empty stays in its leaf with a count of 0 and the tree is compacted once
+// such amounts outnumber the used ones, which keeps removal simple.
+template<typename Product>
+struct Bestsellers<Product, CBTreeBackend> {
+    Bestsellers() : root(0), height(0), tombstones(0) { leaves.emplace_back(); }
 
-    Bestsellers<std::string> T;
-    T.sell("coke", 32);
-    T.sell("bread", 1);
+    std::unordered_map<Product, CBTreeEntry> product_mapping; // Mapping from product to its amount and place
+    std::vector<std::vector<Product>> buckets; // Products grouped by amount
+    std::vector<uint32_t> free_buckets; // Buckets released by compaction
+    std::vector<CBTreeInner> inners; // Inner nodes
+    std::vector<CBTreeLeaf> leaves; // Leaves
+    uint32_t root; // Index of the root, a leaf when height is 0
+    uint32_t height; // Number of inner levels
+    size_t tombstones; // Number of amounts with an empty bucket
+
+    // Result of inserting into a subtree, a split hands a new right sibling to the parent
+    struct CSplit {
+        bool happened;
+        size_t key; // Smallest amount in the new sibling
+        uint32_t node; // Index of the new sibling
+    };
+
+    /**
+     * Function to get the total number of tracked products.
+     * @return The total number of products
+     */
+    size_t products() const {
+        return product_mapping.size();
+    }
+
+    /**
+     * Function to record a sale of a product, moving it to the bucket of its new amount.
+     * @param p The product being sold
+     * @param amount The amount sold
+     */
+    void sell(const Product &p, size_t amount) {
+        auto [it, inserted] = product_mapping.try_emplace(p, CBTreeEntry{amount, 0, 0});
+        if (!inserted) {
+            if (!amount)
+                return;
+            remove(it->second);
+            it->second.amount += amount;
+        }
+        CSplit split = insert(root, height, it->first, it->second);
+        if (split.happened) {
+            uint32_t old_root = root;
+            root = (uint32_t) inners.size();
+            inners.emplace_back();
+            CBTreeInner &node = inners[root];
+            node.size = 2;
+            node.children[0] = old_root;
+            node.children[1] = split.node;
+            node.keys[1] = split.key;
+            totals(old_root, height, node.counts[0], node.sums[0]);
+            totals(split.node, height, node.counts[1], node.sums[1]);
+            height++;
+        }
+        if (tombstones > BTREE_FANOUT && tombstones * 2 > buckets.size() - free_buckets.size())
+            compact();
+    }
+
+    /**
+     * Function to record a batch of sales at once, each product of the batch moves between buckets only once.
+     * @param sales Range of (product, amount) pairs
+     */
+    template<typename Range>
+    void sellBatch(const Range &sales) {
+        std::unordered_map<Product, size_t> totals;
+        for (const auto &[p, amount]: sales)
+            totals[p] += amount;
+        for (const auto &[p, amount]: totals)
+            sell(p, amount);
+    }
+
+    /**
+     * Function to get the rank of a product.
+     * The most sold product has rank 1.
+     * @param p The product to find the rank for
+     * @return The rank of the product
+     */
+    size_t rank(const Product &p) const {
+        auto it = product_mapping.find(p);
+        if (it == product_mapping.end())
+            throw std::out_of_range("there is no product with such a name");
+        return countAbove(it->second.amount, false) + it->second.slot + 1;
+    }
+
+    /**
+     * Function to get the product at a specific rank.
+     * The reference stays valid until the next sale.
+     * @param rank The rank to retrieve
+     * @return The product at the given rank
+     */
+    const Product &product(size_t rank) const {
+        if (rank > product_mapping.size() || rank < 1)
+            throw std::out_of_range("rank is incorrect");
+        uint32_t leaf, pos;
+        size_t offset = select(rank, leaf, pos);
+        return buckets[leaves[leaf].buckets[pos]][offset];
+    }
+
+    /**
+     * Function to get the number of copies sold for a product with a specific rank.
+     * @param rank The rank to check
+     * @return The number of copies sold
+     */
+    size_t sold(size_t rank) const {
+        if (rank > product_mapping.size() || rank < 1)
+            throw std::out_of_range("rank is incorrect");
+        uint32_t leaf, pos;
+        select(rank, leaf, pos);
+        return leaves[leaf].amounts[pos];
+    }
+
+    /**
+     * Function to get the total number of copies sold for products within a rank range.
+     * @param from The starting rank
+     * @param to The ending rank
+     * @return The total number of copies sold within the range
+     */
+    size_t sold(size_t from, size_t to) const {
+        if (from > to || from < 1 || to < 1 || from > product_mapping.size() || to > product_mapping.size())
+            throw std::out_of_range("from is bigger than to");
+        return soldPrefix(to) - soldPrefix(from - 1);
+    }
+
+    /**
+     * Function to get the first rank with the same number of copies sold as a given rank.
+     * @param r The rank to check
+     * @return The first rank with the same number of copies sold
+     */
+    size_t firstSame(size_t r) const {
+        return countAbove(sold(r), false) + 1;
+    }
+
+    /**
+     * Function to get the last rank with the same number of copies sold as a given rank.
+     * @param r The rank to check
+     * @return The last rank with the same number of copies sold
+     */
+    size_t lastSame(size_t r) const {
+        return countAbove(sold(r), true);
+    }
+
+    /**
+     * Function to find the child of an inner node whose subtree holds the given amount.
+     * @param node The inner node
+     * @param amount The amount
+     * @return Position of the child
+     */
+    static uint32_t childFor(const CBTreeInner &node, size_t amount) {
+        uint32_t i = 1;
+        while (i < node.size && node.keys[i] <= amount)
+            i++;
+        return i - 1;
+    }
+
+    /**
+     * Function to sum up the number of products and their amounts in a subtree.
+     * @param node Index of the root of the subtree
+     * @param level Number of inner levels of the subtree
+     * @param count Reference to store the number of products
+     * @param sum Reference to store the total amount
+     */
+    void totals(uint32_t node, uint32_t level, size_t &count, size_t &sum) const {
+        count = sum = 0;
+        if (!level) {
+            const CBTreeLeaf &leaf = leaves[node];
+            for (uint32_t i = 0; i < leaf.size; i++) {
+                count += leaf.counts[i];
+                sum += leaf.counts[i] * leaf.amounts[i];
+            }
+            return;
+        }
+        const CBTreeInner &inner = inners[node];
+        for (uint32_t i = 0; i < inner.size; i++) {
+            count += inner.counts[i];
+            sum += inner.sums[i];
+        }
+    }
+
+    /**
+     * Function to take an empty bucket for a new amount.
+     * @return Index of the bucket
+     */
+    uint32_t newBucket() {
+        if (!free_buckets.empty()) {
+            uint32_t bucket = free_buckets.back();
+            free_buckets.pop_back();
+            return bucket;
+        }
+        buckets.emplace_back();
+        return (uint32_t) buckets.size() - 1;
+    }
+
+    /**
+     * Function to add a product to the bucket of its amount, splitting full nodes on the way back up.
+     * @param node Index of the root of the subtree
+     * @param level Number of inner levels of the subtree
+     * @param p The product
+     * @param entry Mapping entry of the product, its amount selects the bucket, bucket and slot are filled in
+     * @return Description of the split of the subtree root, if any
+     */
+    CSplit insert(uint32_t node, uint32_t level, const Product &p, CBTreeEntry &entry) {
+        if (level) {
+            uint32_t i = childFor(inners[node], entry.amount);
+            inners[node].counts[i]++;
+            inners[node].sums[i] += entry.amount;
+            CSplit split = insert(inners[node].children[i], level - 1, p, entry);
+            if (!split.happened)
+                return split;
+
+            // The child was split, its new sibling goes right after it (the vector may have grown meanwhile)
+            CSplit own = {false, 0, 0};
+            if (inners[node].size == BTREE_FANOUT)
+                own = splitInner(node);
+            uint32_t owner = node;
+            if (own.happened && i >= BTREE_FANOUT / 2) {
+                owner = own.node;
+                i -= BTREE_FANOUT / 2;
+            }
+            CBTreeInner &target = inners[owner];
+            for (uint32_t j = target.size; j > i + 1; j--) {
+                target.children[j] = target.children[j - 1];
+                target.keys[j] = target.keys[j - 1];
+                target.counts[j] = target.counts[j - 1];
+                target.sums[j] = target.sums[j - 1];
+            }
+            target.size++;
+            target.children[i + 1] = split.node;
+            target.keys[i + 1] = split.key;
+            totals(target.children[i], level - 1, target.counts[i], target.sums[i]);
+            totals(target.children[i + 1], level - 1, target.counts[i + 1], target.sums[i + 1]);
+            return own;
+        }
+
+        CBTreeLeaf *leaf = &leaves[node];
+        uint32_t pos = 0;
+        while (pos < leaf->size && leaf->amounts[pos] < entry.amount)
+            pos++;
+        if (pos < leaf->size && leaf->amounts[pos] == entry.amount) {
+            if (!leaf->counts[pos]++)
+                tombstones--;
+            std::vector<Product> &bucket = buckets[leaf->buckets[pos]];
+            entry.bucket = leaf->buckets[pos];
+            entry.slot = (uint32_t) bucket.size();
+            bucket.push_back(p);
+            return {false, 0, 0};
+        }
+
+        CSplit own = {false, 0, 0};
+        uint32_t owner = node;
+        if (leaf->size == BTREE_FANOUT) {
+            own = splitLeaf(node);
+            leaf = &leaves[node];
+            if (pos > BTREE_FANOUT / 2 || (pos == BTREE_FANOUT / 2 && entry.amount >= own.key)) {
+                owner = own.node;
+                pos -= BTREE_FANOUT / 2;
+            }
+        }
+        CBTreeLeaf &target = leaves[owner];
+        for (uint32_t j = target.size; j > pos; j--) {
+            target.amounts[j] = target.amounts[j - 1];
+            target.buckets[j] = target.buckets[j - 1];
+            target.counts[j] = target.counts[j - 1];
+        }
+        target.size++;
+        target.amounts[pos] = entry.amount;
+        target.counts[pos] = 1;
+        target.buckets[pos] = entry.bucket = newBucket();
+        entry.slot = 0;
+        buckets[entry.bucket].push_back(p);
+        if (own.happened && owner == own.node && pos == 0)
+            own.key = entry.amount;
+        return own;
+    }
+
+    /**
+     * Function to move the upper half of a full leaf to a new leaf.
+     * @param node Index of the full leaf
+     * @return Description of the split
+     */
+    CSplit splitLeaf(uint32_t node) {
+        BESTSELLERS_COUNT(splits);
+        uint32_t sibling = (uint32_t) leaves.size();
+        leaves.emplace_back();
+        CBTreeLeaf &from = leaves[node];
+        CBTreeLeaf &to = leaves[sibling];
+        uint32_t half = BTREE_FANOUT / 2;
+        for (uint32_t j = half; j < from.size; j++) {
+            to.amounts[j - half] = from.amounts[j];
+            to.buckets[j - half] = from.buckets[j];
+            to.counts[j - half] = from.counts[j];
+        }
+        to.size = from.size - half;
+        from.size = half;
+        return {true, to.amounts[0], sibling};
+    }
+
+    /**
+     * Function to move the upper half of a full inner node to a new inner node.
+     * @param node Index of the full inner node
+     * @return Description of the split
+     */
+    CSplit splitInner(uint32_t node) {
+        BESTSELLERS_COUNT(splits);
+        uint32_t sibling = (uint32_t) inners.size();
+        inners.emplace_back();
+        CBTreeInner &from = inners[node];
+        CBTreeInner &to = inners[sibling];
+        uint32_t half = BTREE_FANOUT / 2;
+        for (uint32_t j = half; j < from.size; j++) {
+            to.children[j - half] = from.children[j];
+            to.keys[j - half] = from.keys[j];
+            to.counts[j - half] = from.counts[j];
+            to.sums[j - half] = from.sums[j];
+        }
+        to.size = from.size - half;
+        from.size = half;
+        return {true, to.keys[0], sibling};
+    }
+
+    /**
+     * Function to remove a product from its bucket in O(1), the amount stays in its leaf even if nobody has it.
+     * @param entry Mapping entry of the product
+     */
+    void remove(const CBTreeEntry &entry) {
+        uint32_t node = root;
+        for (uint32_t level = height; level; level--) {
+            CBTreeInner &inner = inners[node];
+            uint32_t i = childFor(inner, entry.amount);
+            inner.counts[i]--;
+            inner.sums[i] -= entry.amount;
+            node = inner.children[i];
+        }
+        CBTreeLeaf &leaf = leaves[node];
+        uint32_t pos = 0;
+        while (leaf.amounts[pos] != entry.amount)
+            pos++;
+        if (!--leaf.counts[pos])
+            tombstones++;
+
+        std::vector<Product> &bucket = buckets[entry.bucket];
+        if (entry.slot != bucket.size() - 1) {
+            bucket[entry.slot] = std::move(bucket.back());
+            product_mapping.find(bucket[entry.slot])->second.slot = entry.slot;
+        }
+        bucket.pop_back();
+    }
+
+    /**
+     * Function to rebuild the tree from the amounts that still have products, with leaves and inner nodes
+     * filled to three quarters. Buckets of the dropped amounts are released, the others keep their index.
+     */
+    void compact() {
+        BESTSELLERS_COUNT(compactions);
+        std::vector<CBTreeLeaf> old_leaves;
+        old_leaves.swap(leaves);
+        std::vector<uint32_t> order; // Leaves in ascending order of amounts
+        collectLeaves(root, height, order);
+        inners.clear();
+        tombstones = 0;
+
+        uint32_t fill = BTREE_FANOUT * 3 / 4;
+        leaves.emplace_back();
+        for (uint32_t old: order) {
+            const CBTreeLeaf &from = old_leaves[old];
+            for (uint32_t j = 0; j < from.size; j++) {
+                if (!from.counts[j]) {
+                    free_buckets.push_back(from.buckets[j]);
+                    continue;
+                }
+                if (leaves.back().size == fill)
+                    leaves.emplace_back();
+                CBTreeLeaf &to = leaves.back();
+                to.amounts[to.size] = from.amounts[j];
+                to.buckets[to.size] = from.buckets[j];
+                to.counts[to.size] = from.counts[j];
+                to.size++;
+            }
+        }
+
+        // Build the inner levels bottom-up
+        std::vector<uint32_t> level_nodes(leaves.size());
+        for (uint32_t i = 0; i < leaves.size(); i++)
+            level_nodes[i] = i;
+        height = 0;
+        while (level_nodes.size() > 1) {
+            std::vector<uint32_t> parents;
+            for (size_t i = 0; i < level_nodes.size(); i++) {
+                if (i % fill == 0) {
+                    parents.push_back((uint32_t) inners.size());
+                    inners.emplace_back();
+                }
+                CBTreeInner &parent = inners[parents.back()];
+                uint32_t j = parent.size++;
+                parent.children[j] = level_nodes[i];
+                parent.keys[j] = smallest(level_nodes[i], height);
+                totals(level_nodes[i], height, parent.counts[j], parent.sums[j]);
+            }
+            level_nodes.swap(parents);
+            height++;
+        }
+        root = level_nodes[0];
+    }
+
+    /**
+     * Function to list the leaves of a subtree from left to right.
+     * @param node Index of the root of the subtree
+     * @param level Number of inner levels of the subtree
+     * @param order Vector the leaves are appended to
+     */
+    void collectLeaves(uint32_t node, uint32_t level, std::vector<uint32_t> &order) const {
+        if (!level) {
+            order.push_back(node);
+            return;
+        }
+        for (uint32_t i = 0; i < inners[node].size; i++)
+            collectLeaves(inners[node].children[i], level - 1, order);
+    }
+
+    /**
+     * Function to get the smallest amount of a subtree.
+     * @param node Index of the root of the subtree
+     * @param level Number of inner levels of the subtree
+     * @return The smallest amount
+     */
+    size_t smallest(uint32_t node, uint32_t level) const {
+        for (; level; level--)
+            node = inners[node].children[0];
+        return leaves[node].amounts[0];
+    }
+
+    /**
+     * Helper function to count the products that sold more than, or at least, a given amount.
+     * @param amount The amount
+     * @param inclusive Whether products with exactly the given amount are counted
+     * @return The number of such products
+     */
+    size_t countAbove(size_t amount, bool inclusive) const {
+        size_t result = 0;
+        uint32_t node = root;
+        for (uint32_t level = height; level; level--) {
+            const CBTreeInner &inner = inners[node];
+            uint32_t i = childFor(inner, amount);
+            for (uint32_t j = i + 1; j < inner.size; j++)
+                result += inner.counts[j];
+            node = inner.children[i];
+        }
+        const CBTreeLeaf &leaf = leaves[node];
+        for (uint32_t j = 0; j < leaf.size; j++)
+            if (leaf.amounts[j] > amount || (inclusive && leaf.amounts[j] == amount))
+                result += leaf.counts[j];
+        return result;
+    }
+
+    /**
+     * Helper function to sum up the copies sold by the products that sold more than, or at least, a given amount.
+     * @param amount The amount
+     * @param inclusive Whether products with exactly the given amount are included
+     * @return The total number of copies sold by such products
+     */
+    size_t soldAbove(size_t amount, bool inclusive) const {
+        size_t result = 0;
+        uint32_t node = root;
+        for (uint32_t level = height; level; level--) {
+            const CBTreeInner &inner = inners[node];
+            uint32_t i = childFor(inner, amount);
+            for (uint32_t j = i + 1; j < inner.size; j++)
+                result += inner.sums[j];
+            node = inner.children[i];
+        }
+        const CBTreeLeaf &leaf = leaves[node];
+        for (uint32_t j = 0; j < leaf.size; j++)
+            if (leaf.amounts[j] > amount || (inclusive && leaf.amounts[j] == amount))
+                result += leaf.counts[j] * leaf.amounts[j];
+        return result;
+    }
+
+    /**
+     * Helper function to find the product at a given rank.
+     * @param rank The rank, must be valid
+     * @param leaf Reference to store the leaf holding the amount of the product
+     * @param pos Reference to store the position of the amount in the leaf
+     * @return Position of the product in its bucket
+     */
+    size_t select(size_t rank, uint32_t &leaf, uint32_t &pos) const {
+        uint32_t node = root;
+        for (uint32_t level = height; level; level--) {
+            const CBTreeInner &inner = inners[node];
+            uint32_t j = inner.size - 1;
+            for (; rank > inner.counts[j]; j--)
+                rank -= inner.counts[j];
+            node = inner.children[j];
+        }
+        const CBTreeLeaf &l = leaves[node];
+        uint32_t j = l.size - 1;
+        for (; rank > l.counts[j]; j--)
+            rank -= l.counts[j];
+        leaf = node;
+        pos = j;
+        return rank - 1;
+    }
+
+    /**
+     * Helper function to sum up the copies sold by the products with the highest ranks.
+     * @param rank Number of products to sum up
+     * @return The total number of copies sold by the first rank products
+     */
+    size_t soldPrefix(size_t rank) const {
+        if (!rank)
+            return 0;
+        size_t total = 0;
+        uint32_t node = root;
+        for (uint32_t level = height; level; level--) {
+            const CBTreeInner &inner = inners[node];
+            uint32_t j = inner.size - 1;
+            for (; rank > inner.counts[j]; j--) {
+                rank -= inner.counts[j];
+                total += inner.sums[j];
+            }
+            node = inner.children[j];
+        }
+        const CBTreeLeaf &l = leaves[node];
+        uint32_t j = l.size - 1;
+        for (; rank > l.counts[j]; j--) {
+            rank -= l.counts[j];
+            total += l.counts[j] * l.amounts[j];
+        }
+        return total + rank * l.amounts[j];
+    }
+};
+
+// Immutable node of the trees of a snapshot, shared between all snapshots that contain it
+template<typename Product>
+struct CSnapshotNode {
+    std::shared_ptr<const CSnapshotNode> left; // Left child
+    std::shared_ptr<const CSnapshotNode> right; // Right child
+    const Product *product; // The product, owned by the catalogue of the concurrent tracker
+    size_t amount; // Amount of the product
+    uint64_t stamp; // Ordering among equal amounts in the rank tree, renewed by every sale
+    size_t hash; // Hash of the product, ordering of the index tree
+    size_t id; // Position of the product in the catalogue, ordering among equal hashes in the index tree
+    uint32_t height; // Height of the node
+    size_t count; // Number of products in the subtree including this node
+    size_t sum; // Total amount of the products in the subtree including this node
+};
+
+// Consistent read-only view of a ConcurrentBestsellers at one moment
+template<typename Product>
+struct CSnapshot {
+    using Node = CSnapshotNode<Product>;
+    using Ptr = std::shared_ptr<const Node>;
+
+    Ptr rank_root; // Products ordered by rank, highest amount first
+    Ptr index_root; // Products ordered by hash, used to find the amount of a product
+
+    /**
+     * Function to get the total number of tracked products.
+     * @return The total number of products
+     */
+    size_t products() const {
+        return rank_root ? rank_root->count : 0;
+    }
+
+    /**
+     * Function to get the rank of a product.
+     * @param p The product to find the rank for
+     * @return The rank of the product
+     */
+    size_t rank(const Product &p) const {
+        const Node *item = find(index_root.get(), std::hash<Product>()(p), p);
+        if (!item)
+            throw std::out_of_range("there is no product with such a name");
+        size_t before = 0;
+        for (const Node *node = rank_root.get(); node;) {
+            if (rankBefore(*item, *node))
+                node = node->left.get();
+            else {
+                before += count(node->left) + 1;
+                if (node->stamp == item->stamp && node->amount == item->amount)
+                    return before;
+                node = node->right.get();
+            }
+        }
+        return before;
+    }
+
+    /**
+     * Function to get the product at a specific rank.
+     * The reference stays valid as long as the concurrent tracker exists.
+     * @param rank The rank to retrieve
+     * @return The product at the given rank
+     */
+    const Product &product(size_t rank) const {
+        if (rank > products() || rank < 1)
+            throw std::out_of_range("rank is incorrect");
+        return *select(rank).product;
+    }
+
+    /**
+     * Function to get the number of copies sold for a product with a specific rank.
+     * @param rank The rank to check
+     * @return The number of copies sold
+     */
+    size_t sold(size_t rank) const {
+        if (rank > products() || rank < 1)
+            throw std::out_of_range("rank is incorrect");
+        return select(rank).amount;
+    }
+
+    /**
+     * Function to get the total number of copies sold for products within a rank range.
+     * @param from The starting rank
+     * @param to The ending rank
+     * @return The total number of copies sold within the range
+     */
+    size_t sold(size_t from, size_t to) const {
+        if (from > to || from < 1 || to < 1 || from > products() || to > products())
+            throw std::out_of_range("from is bigger than to");
+        return soldPrefix(to) - soldPrefix(from - 1);
+    }
+
+    /**
+     * Function to get the first rank with the same number of copies sold as a given rank.
+     * @param r The rank to check
+     * @return The first rank with the same number of copies sold
+     */
+    size_t firstSame(size_t r) const {
+        if (r > products() || r < 1)
+            throw std::out_of_range("you cant do this");
+        return countAbove(select(r).amount, false) + 1;
+    }
+
+    /**
+     * Function to get the last rank with the same number of copies sold as a given rank.
+     * @param r The rank to check
+     * @return The last rank with the same number of copies sold
+     */
+    size_t lastSame(size_t r) const {
+        if (r > products() || r < 1)
+            throw std::out_of_range("you cant do this");
+        return countAbove(select(r).amount, true);
+    }
+
+    /**
+     * Function to compare two products by rank, a higher amount comes first, then the older stamp.
+     * @param a First product
+     * @param b Second product
+     * @return True if a has a better rank than b
+     */
+    static bool rankBefore(const Node &a, const Node &b) {
+        return a.amount > b.amount || (a.amount == b.amount && a.stamp < b.stamp);
+    }
+
+    /**
+     * Function to compare two products in the index, by hash and then by product id.
+     * @param a First product
+     * @param b Second product
+     * @return True if a comes before b
+     */
+    static bool indexBefore(const Node &a, const Node &b) {
+        return a.hash < b.hash || (a.hash == b.hash && a.id < b.id);
+    }
+
+    static size_t count(const Ptr &node) { return node ? node->count : 0; }
+
+    static size_t sum(const Ptr &node) { return node ? node->sum : 0; }
+
+    static uint32_t height(const Ptr &node) { return node ? node->height : 0; }
+
+    /**
+     * Function to find a product in the index tree, products with the same hash are searched on both sides.
+     * @param node The root of the index tree
+     * @param hash Hash of the product
+     * @param p The product
+     * @return The node of the product, or nullptr if it is not there
+     */
+    static const Node *find(const Node *node, size_t hash, const Product &p) {
+        while (node && hash != node->hash)
+            node = hash < node->hash ? node->left.get() : node->right.get();
+        if (!node)
+            return nullptr;
+        if (*node->product == p)
+            return node;
+        if (const Node *found = find(node->left.get(), hash, p))
+            return found;
+        return find(node->right.get(), hash, p);
+    }
+
+    /**
+     * Helper function to find the node with a given rank in the rank tree.
+     * @param rank The rank, must be valid
+     * @return The node at the given rank
+     */
+    const Node &select(size_t rank) const {
+        const Node *node = rank_root.get();
+        while (true) {
+            size_t left = count(node->left);
+            if (rank <= left)
+                node = node->left.get();
+            else if (rank == left + 1)
+                return *node;
+            else {
+                rank -= left + 1;
+                node = node->right.get();
+            }
+        }
+    }
+
+    /**
+     * Helper function to sum up the copies sold by the products with the highest ranks.
+     * @param rank Number of products to sum up
+     * @return The total number of copies sold by the first rank products
+     */
+    size_t soldPrefix(size_t rank) const {
+        size_t total = 0;
+        for (const Node *node = rank_root.get(); node && rank;) {
+            size_t left = count(node->left);
+            if (rank <= left)
+                node = node->left.get();
+            else {
+                total += sum(node->left) + node->amount;
+                rank -= left + 1;
+                node = node->right.get();
+            }
+        }
+        return total;
+    }
+
+    /**
+     * Helper function to count the products that sold more than, or at least, a given amount.
+     * @param amount The amount
+     * @param inclusive Whether products with exactly the given amount are counted
+     * @return The number of such products
+     */
+    size_t countAbove(size_t amount, bool inclusive) const {
+        size_t result = 0;
+        for (const Node *node = rank_root.get(); node;) {
+            if (node->amount > amount || (inclusive && node->amount == amount)) {
+                result += count(node->left) + 1;
+                node = node->right.get();
+            } else
+                node = node->left.get();
+        }
+        return result;
+    }
+};
+
+// Bestsellers that can be queried by any number of threads while sales are being recorded. Every sale builds
+// a new snapshot by copying the paths it changes in the persistent trees of the previous one, so readers keep
+// using the snapshot they took without locks and without being affected by the writer.
+template<typename Product>
+struct ConcurrentBestsellers {
+    using Node = CSnapshotNode<Product>;
+    using Ptr = std::shared_ptr<const Node>;
+
+    ConcurrentBestsellers() : published(std::make_shared<const CSnapshot<Product>>()) {}
+
+    std::shared_ptr<const CSnapshot<Product>> published; // The latest snapshot, accessed atomically
+    std::mutex writer_mutex; // Serializes writers
+    std::deque<Product> catalogue; // All products ever sold, never moved so snapshots can point to them
+    std::unordered_map<Product, Node> product_mapping; // Writer-side copy of the current entry of each product
+    uint64_t next_stamp = 0; // Stamp given to the next changed product
+
+    /**
+     * Function to get the latest snapshot. The snapshot does not change, but must not outlive the tracker.
+     * @return The latest snapshot
+     */
+    std::shared_ptr<const CSnapshot<Product>> snapshot() const {
+        return std::atomic_load(&published);
+    }
+
+    /**
+     * Function to record a sale of a product and publish the resulting snapshot.
+     * @param p The product being sold
+     * @param amount The amount sold
+     */
+    void sell(const Product &p, size_t amount) {
+        std::lock_guard<std::mutex> lock(writer_mutex);
+        CSnapshot<Product> next = *std::atomic_load(&published);
+        apply(next, p, amount);
+        std::atomic_store(&published, std::make_shared<const CSnapshot<Product>>(std::move(next)));
+    }
+
+    /**
+     * Function to record a batch of sales and publish a single snapshot after all of them.
+     * @param sales Range of (product, amount) pairs
+     */
+    template<typename Range>
+    void sellBatch(const Range &sales) {
+        std::lock_guard<std::mutex> lock(writer_mutex);
+        CSnapshot<Product> next = *std::atomic_load(&published);
+        for (const auto &sale: sales)
+            apply(next, sale.first, sale.second);
+        std::atomic_store(&published, std::make_shared<const CSnapshot<Product>>(std::move(next)));
+    }
+
+    size_t products() const { return snapshot()->products(); }
+
+    size_t rank(const Product &p) const { return snapshot()->rank(p); }
+
+    const Product &product(size_t rank) const { return snapshot()->product(rank); }
+
+    size_t sold(size_t rank) const { return snapshot()->sold(rank); }
+
+    size_t sold(size_t from, size_t to) const { return snapshot()->sold(from, to); }
+
+    size_t firstSame(size_t r) const { return snapshot()->firstSame(r); }
+
+    size_t lastSame(size_t r) const { return snapshot()->lastSame(r); }
+
+    /**
+     * Helper function to record a sale in a snapshot that has not been published yet.
+     * @param next The snapshot being built
+     * @param p The product being sold
+     * @param amount The amount sold
+     */
+    void apply(CSnapshot<Product> &next, const Product &p, size_t amount) {
+        auto it = product_mapping.find(p);
+        if (it == product_mapping.end()) {
+            catalogue.push_back(p);
+            Node item{};
+            item.product = &catalogue.back();
+            item.hash = std::hash<Product>()(p);
+            item.id = catalogue.size() - 1;
+            item.amount = amount;
+            item.stamp = next_stamp++;
+            it = product_mapping.emplace(p, item).first;
+            next.index_root = insert(next.index_root, item, CSnapshot<Product>::indexBefore);
+            next.rank_root = insert(next.rank_root, item, CSnapshot<Product>::rankBefore);
+            return;
+        }
+        if (!amount)
+            return;
+        Node &item = it->second;
+        next.rank_root = erase(next.rank_root, item, CSnapshot<Product>::rankBefore);
+        item.amount += amount;
+        item.stamp = next_stamp++;
+        next.rank_root = insert(next.rank_root, item, CSnapshot<Product>::rankBefore);
+        next.index_root = replace(next.index_root, item, CSnapshot<Product>::indexBefore);
+    }
+
+    /**
+     * Function to create a node with the payload of item and the given children.
+     * @param left Left child
+     * @param item Payload of the node
+     * @param right Right child
+     * @return The new node
+     */
+    static Ptr make(Ptr left, const Node &item, Ptr right) {
+        uint32_t height = std::max(CSnapshot<Product>::height(left), CSnapshot<Product>::height(right)) + 1;
+        size_t count = CSnapshot<Product>::count(left) + CSnapshot<Product>::count(right) + 1;
+        size_t sum = CSnapshot<Product>::sum(left) + CSnapshot<Product>::sum(right) + item.amount;
+        return std::make_shared<const Node>(Node{std::move(left), std::move(right), item.product, item.amount,
+                                                 item.stamp, item.hash, item.id, height, count, sum});
+    }
+
+    /**
+     * Function to create a node like make(), rotating once or twice when the children differ in height by 2.
+     * @param left Left child
+     * @param item Payload of the node
+     * @param right Right child
+     * @return The new root of the subtree
+     */
+    static Ptr balance(const Ptr &left, const Node &item, const Ptr &right) {
+        uint32_t hl = CSnapshot<Product>::height(left);
+        uint32_t hr = CSnapshot<Product>::height(right);
+        if (hl > hr + 1) {
+            if (CSnapshot<Product>::height(left->left) >= CSnapshot<Product>::height(left->right))
+                return make(left->left, *left, make(left->right, item, right));
+            return make(make(left->left, *left, left->right->left), *left->right,
+                        make(left->right->right, item, right));
+        }
+        if (hr > hl + 1) {
+            if (CSnapshot<Product>::height(right->right) >= CSnapshot<Product>::height(right->left))
+                return make(make(left, item, right->left), *right, right->right);
+            return make(make(left, item, right->left->left), *right->left,
+                        make(right->left->right, *right, right->right));
+        }
+        return make(left, item, right);
+    }
+
+    /**
+     * Function to insert an item, copying the path from the root to it.
+     * @param node Root of the subtree
+     * @param item The item to insert
+     * @param before Ordering of the tree
+     * @return The new root of the subtree
+     */
+    template<typename Before>
+    static Ptr insert(const Ptr &node, const Node &item, Before before) {
+        if (!node)
+            return make(nullptr, item, nullptr);
+        if (before(item, *node))
+            return balance(insert(node->left, item, before), *node, node->right);
+        return balance(node->left, *node, insert(node->right, item, before));
+    }
+
+    /**
+     * Function to replace the payload of an item that is in the tree, copying the path from the root to it.
+     * @param node Root of the subtree
+     * @param item The item with the new payload
+     * @param before Ordering of the tree, the item must keep its place
+     * @return The new root of the subtree
+     */
+    template<typename Before>
+    static Ptr replace(const Ptr &node, const Node &item, Before before) {
+        if (before(item, *node))
+            return make(replace(node->left, item, before), *node, node->right);
+        if (before(*node, item))
+            return make(node->left, *node, replace(node->right, item, before));
+        return make(node->left, item, node->right);
+    }
+
+    /**
+     * Function to remove the leftmost item of a subtree, copying the path to it.
+     * @param node Root of the subtree, not empty
+     * @param removed Reference to store the removed node
+     * @return The new root of the subtree
+     */
+    static Ptr eraseMin(const Ptr &node, Ptr &removed) {
+        if (!node->left) {
+            removed = node;
+            return node->right;
+        }
+        return balance(eraseMin(node->left, removed), *node, node->right);
+    }
+
+    /**
+     * Function to remove an item, copying the path from the root to it.
+     * @param node Root of the subtree
+     * @param item The item to remove, must be in the tree
+     * @param before Ordering of the tree
+     * @return The new root of the subtree
+     */
+    template<typename Before>
+    static Ptr erase(const Ptr &node, const Node &item, Before before) {
+        if (before(item, *node))
+            return balance(erase(node->left, item, before), *node, node->right);
+        if (before(*node, item))
+            return balance(node->left, *node, erase(node->right, item, before));
+        if (!node->left)
+            return node->right;
+        if (!node->right)
+            return node->left;
+        Ptr successor;
+        Ptr right = eraseMin(node->right, successor);
+        return balance(node->left, *successor, right);
+    }
+};
+
+// Bestsellers counting only the sales of a sliding time window. Sales are summed up per product in buckets of
+// bucket_width time units and when a bucket leaves the window, its totals are withdrawn from the tree, so an
+// eviction costs one O(log n) update per distinct product of the bucket instead of one per sale.
+template<typename Product>
+struct WindowedBestsellers {
+    // Sales of the products in one period of bucket_width time units
+    struct CTimeBucket {
+        uint64_t start; // First time of the period
+        std::unordered_map<Product, size_t> sales; // Total amount sold of each product within the period
+    };
+
+    /**
+     * Constructor of the windowed tracker.
+     * A sale made at time t counts until the time reaches the start of its bucket plus window.
+     * @param window Length of the window, should be a multiple of bucket_width
+     * @param bucket_width Granularity of the window
+     */
+    WindowedBestsellers(uint64_t window, uint64_t bucket_width)
+        : window(window), bucket_width(bucket_width), now(0) {
+        if (!bucket_width || window < bucket_width)
+            throw std::invalid_argument("window is shorter than a bucket");
+    }
+
+    Bestsellers<Product> tree; // Totals of the sales within the window
+    std::deque<CTimeBucket> buckets; // Buckets within the window with at least one sale, the oldest first
+    uint64_t window; // Length of the window
+    uint64_t bucket_width; // Length of one bucket
+    uint64_t now; // Latest time seen
+
+    /**
+     * Function to record a sale made at a given time, moving the window forward if the time is newer.
+     * Sales that are already out of the window and sales of 0 copies are ignored.
+     * @param p The product being sold
+     * @param amount The amount sold
+     * @param time Time of the sale
+     */
+    void sell(const Product &p, size_t amount, uint64_t time) {
+        advance(time);
+        uint64_t start = time - time % bucket_width;
+        if (!amount || start + window <= now)
+            return;
+        auto bucket = std::lower_bound(buckets.begin(), buckets.end(), start, [](const CTimeBucket &b, uint64_t s) {
+            return b.start < s;
+        });
+        if (bucket == buckets.end() || bucket->start != start)
+            bucket = buckets.insert(bucket, CTimeBucket{start, {}});
+        bucket->sales[p] += amount;
+        tree.sell(p, amount);
+    }
+
+    /**
+     * Function to move the window to a given time and withdraw the sales of the buckets that left it.
+     * Times older than the latest one seen do not move the window back.
+     * @param time The current time
+     */
+    void advance(uint64_t time) {
+        if (time <= now)
+            return;
+        now = time;
+        while (!buckets.empty() && buckets.front().start + window <= now) {
+            for (const auto &[product, amount]: buckets.front().sales)
+                tree.withdraw(product, amount);
+            buckets.pop_front();
+        }
+    }
+
+    /**
+     * Function to get the number of products sold within the window.
+     * @return The number of products
+     */
+    size_t products() const {
+        return tree.products();
+    }
+
+    /**
+     * Function to get the rank of a product within the window.
+     * @param p The product
+     * @return The rank of the product
+     */
+    size_t rank(const Product &p) const {
+        return tree.rank(p);
+    }
+
+    /**
+     * Function to get the product at a specific rank within the window.
+     * @param r The rank
+     * @return The product at the given rank
+     */
+    const Product &product(size_t r) const {
+        return tree.product(r);
+    }
+
+    /**
+     * Function to get the number of copies sold within the window by the product with a specific rank.
+     * @param r The rank
+     * @return The number of copies sold
+     */
+    size_t sold(size_t r) const {
+        return tree.sold(r);
+    }
+
+    /**
+     * Function to get the number of copies sold within the window by the products within a rank range.
+     * @param from The starting rank
+     * @param to The ending rank
+     * @return The total number of copies sold
+     */
+    size_t sold(size_t from, size_t to) const {
+        return tree.sold(from, to);
+    }
+
+    /**
+     * Function to get the first rank with the same number of copies sold as a given rank.
+     * @param r The rank
+     * @return The first rank with the same number of copies sold
+     */
+    size_t firstSame(size_t r) const {
+        return tree.firstSame(r);
+    }
+
+    /**
+     * Function to get the last rank with the same number of copies sold as a given rank.
+     * @param r The rank
+     * @return The last rank with the same number of copies sold
+     */
+    size_t lastSame(size_t r) const {
+        return tree.lastSame(r);
+    }
+};
+
+// Table of product names, each stored once and identified by a dense 32-bit id in the order of interning.
+// Names live in a deque that never moves them, so the lookup table can key on views into it and any
+// std::string_view can be looked up without building a std::string.
+struct CProductInterner {
+    std::deque<std::string> names; // Name of every id
+    std::unordered_map<std::string_view, uint32_t> ids; // Id of every name, the keys view into names
+
+    /**
+     * Function to get the id of a name, assigning the next id to a new name.
+     * @param name The name
+     * @return The id of the name
+     */
+    uint32_t intern(std::string_view name) {
+        auto it = ids.find(name);
+        if (it != ids.end())
+            return it->second;
+        if (names.size() >= NIL_NODE)
+            throw std::length_error("too many products");
+        names.emplace_back(name);
+        uint32_t id = (uint32_t) names.size() - 1;
+        ids.emplace(names.back(), id);
+        return id;
+    }
+
+    /**
+     * Function to get the id of a name that was interned before.
+     * @param name The name
+     * @return The id of the name
+     */
+    uint32_t id(std::string_view name) const {
+        auto it = ids.find(name);
+        if (it == ids.end())
+            throw std::out_of_range("there is no product with such a name");
+        return it->second;
+    }
+
+    /**
+     * Function to get the name of an id.
+     * @param id The id
+     * @return The name
+     */
+    const std::string &name(uint32_t id) const {
+        return names[id];
+    }
+};
+
+// Bestsellers of products named by strings. Every name is interned once and the tree and its mapping work with
+// 32-bit ids only, so a name is stored once instead of twice and hashing or comparing names happens only at the
+// boundary. All functions taking a product accept anything convertible to std::string_view.
+template<typename Backend = CAvlBackend>
+struct InternedBestsellers {
+    CProductInterner interner; // Names of the products
+    Bestsellers<uint32_t, Backend> tree; // Ranking of the ids
+
+    /**
+     * Function to get the total number of tracked products.
+     * @return The total number of products
+     */
+    size_t products() const {
+        return tree.products();
+    }
+
+    /**
+     * Function to record a sale of a product.
+     * @param p The name of the product being sold
+     * @param amount The amount sold
+     */
+    void sell(std::string_view p, size_t amount) {
+        tree.sell(interner.intern(p), amount);
+    }
+
+    /**
+     * Function to record a batch of sales at once.
+     * @param sales Range of (name, amount) pairs
+     */
+    template<typename Range>
+    void sellBatch(const Range &sales) {
+        std::vector<std::pair<uint32_t, size_t>> ids;
+        for (const auto &[p, amount]: sales)
+            ids.emplace_back(interner.intern(p), amount);
+        tree.sellBatch(ids);
+    }
+
+    /**
+     * Function to take back copies of a product.
+     * @param p The name of the product
+     * @param amount The amount to take back
+     */
+    void withdraw(std::string_view p, size_t amount) {
+        tree.withdraw(interner.id(p), amount);
+    }
+
+    /**
+     * Function to get the rank of a product.
+     * @param p The name of the product
+     * @return The rank of the product
+     */
+    size_t rank(std::string_view p) const {
+        return tree.rank(interner.id(p));
+    }
+
+    /**
+     * Function to get the product at a specific rank.
+     * @param r The rank
+     * @return The name of the product, valid as long as the tracker
+     */
+    const std::string &product(size_t r) const {
+        return interner.name(tree.product(r));
+    }
+
+    /**
+     * Function to get the number of copies sold for a product with a specific rank.
+     * @param r The rank
+     * @return The number of copies sold
+     */
+    size_t sold(size_t r) const {
+        return tree.sold(r);
+    }
+
+    /**
+     * Function to get the total number of copies sold for products within a rank range.
+     * @param from The starting rank
+     * @param to The ending rank
+     * @return The total number of copies sold
+     */
+    size_t sold(size_t from, size_t to) const {
+        return tree.sold(from, to);
+    }
+
+    /**
+     * Function to get the first rank with the same number of copies sold as a given rank.
+     * @param r The rank
+     * @return The first rank with the same number of copies sold
+     */
+    size_t firstSame(size_t r) const {
+        return tree.firstSame(r);
+    }
+
+    /**
+     * Function to get the last rank with the same number of copies sold as a given rank.
+     * @param r The rank
+     * @return The last rank with the same number of copies sold
+     */
+    size_t lastSame(size_t r) const {
+        return tree.lastSame(r);
+    }
+};
+
+// Default assignment of the products of ShardedBestsellers to shards by their hash
+template<typename Product>
+struct CHashShard {
+    size_t operator()(const Product &p, size_t shards) const {
+        return std::hash<Product>()(p) % shards;
+    }
+};
+
+// Bestsellers split into shards, e.g. one per store category, each with its own tree and lock, so sales of
+// different shards are recorded in parallel. The global ranking is not stored anywhere: a global query locks all
+// shards for reading and finds the amount at the wanted rank by a binary search over amounts, asking every shard
+// how many products sold at least that much. Products with the same amount are ranked by their shard first.
+template<typename Product, typename ShardOf = CHashShard<Product>, typename Backend = CAvlBackend>
+struct ShardedBestsellers {
+    // One shard of the products
+    struct CShard {
+        mutable std::shared_mutex mutex; // Exclusive for sales, shared for queries
+        Bestsellers<Product, Backend> tree; // Ranking within the shard
+    };
+
+    /**
+     * Constructor of the sharded tracker.
+     * @param count Number of shards
+     * @param shard_of Callable returning the shard of a product, given the product and the number of shards
+     */
+    explicit ShardedBestsellers(size_t count, ShardOf shard_of = ShardOf()) : shards(count), shard_of(shard_of) {
+        if (!count)
+            throw std::invalid_argument("there must be a shard");
+    }
+
+    std::vector<CShard> shards; // The shards
+    ShardOf shard_of; // Assignment of products to shards
+
+    /**
+     * Function to get the shard of a product.
+     * @param p The product
+     * @return Index of the shard
+     */
+    size_t shardOf(const Product &p) const {
+        return shard_of(p, shards.size());
+    }
+
+    /**
+     * Function to record a sale of a product, locking only its shard.
+     * @param p The product being sold
+     * @param amount The amount sold
+     */
+    void sell(const Product &p, size_t amount) {
+        CShard &shard = shards[shardOf(p)];
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        shard.tree.sell(p, amount);
+    }
+
+    /**
+     * Function to record a batch of sales. The batch is split by shard and every part is recorded by its own
+     * thread with sellBatch of the shard.
+     * @param sales Range of (product, amount) pairs
+     */
+    template<typename Range>
+    void sellBatch(const Range &sales) {
+        std::vector<std::vector<std::pair<Product, size_t>>> parts(shards.size());
+        for (const auto &[p, amount]: sales)
+            parts[shardOf(p)].emplace_back(p, amount);
+
+        auto apply = [this, &parts](size_t index) {
+            std::unique_lock<std::shared_mutex> lock(shards[index].mutex);
+            shards[index].tree.sellBatch(parts[index]);
+        };
+        std::vector<std::thread> threads;
+        size_t last = shards.size();
+        for (size_t i = 0; i < shards.size(); i++) {
+            if (parts[i].empty())
+                continue;
+            if (last != shards.size())
+                threads.emplace_back(apply, last);
+            last = i;
+        }
+        if (last != shards.size())
+            apply(last); // The calling thread takes one part itself
+        for (auto &thread: threads)
+            thread.join();
+    }
+
+    /**
+     * Function to get the total number of tracked products.
+     * @return The total number of products
+     */
+    size_t products() const {
+        auto locks = lockAll();
+        return count();
+    }
+
+    /**
+     * Function to get the global rank of a product.
+     * @param p The product
+     * @return The rank of the product among the products of all shards
+     */
+    size_t rank(const Product &p) const {
+        auto locks = lockAll();
+        size_t index = shardOf(p);
+        const auto &tree = shards[index].tree;
+        size_t local = tree.rank(p);
+        size_t amount = tree.sold(local);
+        size_t result = local - tree.firstSame(local) + 1;
+        for (size_t i = 0; i < shards.size(); i++)
+            result += shards[i].tree.countAbove(amount, i < index);
+        return result;
+    }
+
+    /**
+     * Function to get the product at a specific global rank.
+     * The product is returned by value, as other threads may change the shards after the call.
+     * @param r The rank
+     * @return The product at the given rank
+     */
+    Product product(size_t r) const {
+        auto locks = lockAll();
+        if (r > count() || r < 1)
+            throw std::out_of_range("rank is incorrect");
+        size_t amount = amountAt(r);
+        size_t tie = r - countAbove(amount, false); // Position among the products with this amount
+        for (const auto &shard: shards) {
+            size_t above = shard.tree.countAbove(amount, false);
+            size_t same = shard.tree.countAbove(amount, true) - above;
+            if (tie <= same)
+                return shard.tree.product(above + tie);
+            tie -= same;
+        }
+        throw std::logic_error("shards changed during a query");
+    }
+
+    /**
+     * Function to get the number of copies sold for a product with a specific global rank.
+     * @param r The rank
+     * @return The number of copies sold
+     */
+    size_t sold(size_t r) const {
+        auto locks = lockAll();
+        if (r > count() || r < 1)
+            throw std::out_of_range("rank is incorrect");
+        return amountAt(r);
+    }
+
+    /**
+     * Function to get the total number of copies sold for products within a global rank range.
+     * @param from The starting rank
+     * @param to The ending rank
+     * @return The total number of copies sold within the range
+     */
+    size_t sold(size_t from, size_t to) const {
+        auto locks = lockAll();
+        size_t n = count();
+        if (from > to || from < 1 || to < 1 || from > n || to > n)
+            throw std::out_of_range("from is bigger than to");
+        return soldPrefix(to) - soldPrefix(from - 1);
+    }
+
+    /**
+     * Function to get the first global rank with the same number of copies sold as a given rank.
+     * @param r The rank
+     * @return The first rank with the same number of copies sold
+     */
+    size_t firstSame(size_t r) const {
+        auto locks = lockAll();
+        if (r > count() || r < 1)
+            throw std::out_of_range("you cant do this");
+        return countAbove(amountAt(r), false) + 1;
+    }
+
+    /**
+     * Function to get the last global rank with the same number of copies sold as a given rank.
+     * @param r The rank
+     * @return The last rank with the same number of copies sold
+     */
+    size_t lastSame(size_t r) const {
+        auto locks = lockAll();
+        if (r > count() || r < 1)
+            throw std::out_of_range("you cant do this");
+        return countAbove(amountAt(r), true);
+    }
+
+    /**
+     * Function to get the rank of a product within its shard, e.g. within its category.
+     * @param p The product
+     * @return The rank of the product in its shard
+     */
+    size_t localRank(const Product &p) const {
+        const CShard &shard = shards[shardOf(p)];
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        return shard.tree.rank(p);
+    }
+
+    /**
+     * Helper function to lock all shards for reading, always in the same order.
+     * @return The locks
+     */
+    std::vector<std::shared_lock<std::shared_mutex>> lockAll() const {
+        std::vector<std::shared_lock<std::shared_mutex>> locks;
+        locks.reserve(shards.size());
+        for (const auto &shard: shards)
+            locks.emplace_back(shard.mutex);
+        return locks;
+    }
+
+    /**
+     * Helper function to get the number of products of all shards, the shards must be locked.
+     * @return The number of products
+     */
+    size_t count() const {
+        size_t result = 0;
+        for (const auto &shard: shards)
+            result += shard.tree.products();
+        return result;
+    }
+
+    /**
+     * Helper function to count the products of all shards that sold more than, or at least, a given amount.
+     * @param amount The amount
+     * @param inclusive Whether products with exactly the given amount are counted
+     * @return The number of such products
+     */
+    size_t countAbove(size_t amount, bool inclusive) const {
+        size_t result = 0;
+        for (const auto &shard: shards)
+            result += shard.tree.countAbove(amount, inclusive);
+        return result;
+    }
+
+    /**
+     * Helper function to find the amount sold by the product at a global rank, by a binary search for the
+     * highest amount that at least r products reached. Each step asks every shard, so a query costs
+     * O(log(max amount) * shards * log n).
+     * @param r The rank, must be valid
+     * @return The amount
+     */
+    size_t amountAt(size_t r) const {
+        size_t low = std::numeric_limits<size_t>::max(), high = 0;
+        for (const auto &shard: shards) {
+            size_t n = shard.tree.products();
+            if (!n)
+                continue;
+            low = std::min(low, shard.tree.sold(n));
+            high = std::max(high, shard.tree.sold(1));
+        }
+        while (low < high) {
+            size_t middle = low + (high - low + 1) / 2;
+            if (countAbove(middle, true) >= r)
+                low = middle;
+            else
+                high = middle - 1;
+        }
+        return low;
+    }
+
+    /**
+     * Helper function to sum up the copies sold by the products with the best global ranks.
+     * @param r Number of products to sum up
+     * @return The total number of copies sold by them
+     */
+    size_t soldPrefix(size_t r) const {
+        if (!r)
+            return 0;
+        size_t amount = amountAt(r);
+        size_t sum = 0;
+        for (const auto &shard: shards)
+            sum += shard.tree.soldAbove(amount, false);
+        return sum + (r - countAbove(amount, false)) * amount;
+    }
+};
+
+#ifndef __PROGTEST__
+
+/**
+ * Test case 1: Testing various functionalities of the Bestsellers class.
+ */
+void test1() {
+    Bestsellers<std::string> T;
+    T.sell("coke", 32);
+    T.sell("bread", 1);
+    assert(T.products() == 2);
+    T.sell("ham", 2);
+    T.sell("mushrooms", 12);
+    T.sell("bla", 12);
+    T.sell("apple", 12);
+    T.sell("oi", 1);
+    T.sell("nanana", 1);
+    T.sell("kukuku", 1);
+
+    assert(T.firstSame(2) == 2);
+    assert(T.lastSame(2) == 4);
+    assert(T.sold(2) == T.sold(4));
+
+    assert(T.firstSame(7) == 6);
+    assert(T.lastSame(7) == 9);
+    assert(T.sold(7) == T.sold(6) == T.sold(8) == T.sold(9));
+}
+
+/**
+ * Test case 2: Testing exceptions and error handling.
+ */
+void test2() {
+# define CATCH(expr) \
+  try { expr; assert(0); } catch (const std::out_of_range&) { assert(1); };
+
+    Bestsellers<std::string> T;
+    T.sell("coke", 32);
+    T.sell("bread", 1);
 
     CATCH(T.rank("ham"));
     CATCH(T.product(3));
@@ -580,6 +2721,350 @@ void test2() {
 #undef CATCH
 }
 
+/**
+ * Test case 3: Comparing the tree against a brute force model on a random sale stream.
+ */
+template<typename Tracker>
+void test3() {
+    Tracker T;
+    std::unordered_map<int, size_t> model;
+    std::mt19937 rng(42);
+    for (int i = 0; i < 3000; i++) {
+        int p = (int) (rng() % 300);
+        size_t amount = rng() % 5 + 1;
+        T.sell(p, amount);
+        model[p] += amount;
+    }
+    assert(T.products() == model.size());
+
+    std::vector<size_t> amounts;
+    for (const auto &item: model)
+        amounts.push_back(item.second);
+    std::sort(amounts.begin(), amounts.end(), std::greater<>());
+
+    for (const auto &item: model) {
+        size_t r = T.rank(item.first);
+        assert(T.product(r) == item.first);
+        assert(T.sold(r) == item.second);
+    }
+    for (size_t r = 1; r <= amounts.size(); r++) {
+        assert(T.sold(r) == amounts[r - 1]);
+        assert(amounts[T.firstSame(r) - 1] == amounts[r - 1]);
+        assert(T.firstSame(r) == 1 || amounts[T.firstSame(r) - 2] != amounts[r - 1]);
+        assert(amounts[T.lastSame(r) - 1] == amounts[r - 1]);
+        assert(T.lastSame(r) == amounts.size() || amounts[T.lastSame(r)] != amounts[r - 1]);
+    }
+    for (size_t from = 1; from <= amounts.size(); from += 7)
+        for (size_t to = from; to <= amounts.size(); to += 13) {
+            size_t expected = 0;
+            for (size_t r = from; r <= to; r++)
+                expected += amounts[r - 1];
+            assert(T.sold(from, to) == expected);
+        }
+}
+
+/**
+ * Test case 4: Batched sales must leave the tree in the same state as selling one by one.
+ */
+void test4() {
+    Bestsellers<int> batched, single;
+    std::mt19937 rng(7);
+    for (size_t batch_size: {5, 50, 2000, 20, 5000}) {
+        std::vector<std::pair<int, size_t>> batch;
+        for (size_t i = 0; i < batch_size; i++)
+            batch.emplace_back((int) (rng() % 1000), rng() % 10);
+        batched.sellBatch(batch);
+        for (const auto &sale: batch)
+            single.sell(sale.first, sale.second);
+
+        assert(batched.products() == single.products());
+        for (const auto &item: single.product_mapping) {
+            size_t r = batched.rank(item.first);
+            assert(batched.product(r) == item.first);
+            assert(batched.sold(r) == item.second.amount);
+            assert(single.sold(r) == item.second.amount);
+        }
+        assert(batched.sold(1, batched.products()) == single.sold(1, single.products()));
+    }
+}
+
+/**
+ * Test case 5: Snapshots of the concurrent tracker agree with Bestsellers and do not change after later sales.
+ */
+void test5() {
+    ConcurrentBestsellers<std::string> C;
+    Bestsellers<std::string> T;
+    std::mt19937 rng(3);
+    std::shared_ptr<const CSnapshot<std::string>> early;
+    for (int i = 0; i < 2000; i++) {
+        std::string p = "p" + std::to_string(rng() % 200);
+        size_t amount = rng() % 4;
+        C.sell(p, amount);
+        T.sell(p, amount);
+        if (i == 1000) {
+            early = C.snapshot();
+            assert(early->sold(1, early->products()) == T.sold(1, T.products()));
+        }
+    }
+    size_t early_total = early->sold(1, early->products());
+
+    std::vector<std::pair<std::string, size_t>> batch = {{"p1", 5}, {"new", 3}, {"p1", 2}};
+    C.sellBatch(batch);
+    T.sellBatch(batch);
+
+    assert(C.products() == T.products());
+    for (size_t r = 1; r <= T.products(); r++) {
+        assert(C.sold(r) == T.sold(r));
+        assert(C.firstSame(r) == T.firstSame(r));
+        assert(C.lastSame(r) == T.lastSame(r));
+        assert(C.rank(C.product(r)) == r);
+        assert(C.sold(1, r) == T.sold(1, r));
+    }
+    assert(early->sold(1, early->products()) == early_total);
+    assert(early_total < C.sold(1, C.products()));
+}
+
+/**
+ * Test case 6: Iterating over the ranks visits the same products as product(r) and sold(r).
+ */
+void test6() {
+    Bestsellers<std::string> T;
+    assert(T.begin() == T.end());
+    std::mt19937 rng(11);
+    for (int i = 0; i < 5000; i++)
+        T.sell("p" + std::to_string(rng() % 700), rng() % 6);
+
+    size_t expected_rank = 1;
+    for (const auto &item: T) {
+        assert(item.rank == expected_rank);
+        assert(&item.product == &T.product(item.rank));
+        assert(item.amount == T.sold(item.rank));
+        expected_rank++;
+    }
+    assert(expected_rank == T.products() + 1);
+
+    for (size_t from: {1, 2, 17, 350, 699, 700}) {
+        size_t r = from;
+        for (auto it = T.rankedFrom(from); it != T.end() && r < from + 100; ++it, r++)
+            assert((*it).rank == r && (*it).product == T.product(r));
+    }
+    assert(T.rankedFrom(T.products() + 1) == T.end());
+}
+
+/**
+ * Test case 7: Saving and loading restores the same ranks and amounts, invalid data are rejected.
+ */
+void test7() {
+    Bestsellers<std::string> T;
+    std::mt19937 rng(13);
+    for (int i = 0; i < 5000; i++)
+        T.sell("p" + std::to_string(rng() % 800), rng() % 9);
+    std::stringstream stream;
+    T.save(stream);
+
+    Bestsellers<std::string> L;
+    L.sell("old", 5);
+    L.load(stream);
+    assert(L.products() == T.products());
+    assert(!L.product_mapping.count("old"));
+    for (size_t r = 1; r <= T.products(); r++) {
+        assert(L.product(r) == T.product(r) && L.sold(r) == T.sold(r));
+        assert(L.rank(T.product(r)) == r);
+        assert(L.firstSame(r) == T.firstSame(r) && L.lastSame(r) == T.lastSame(r));
+    }
+    for (int i = 0; i < 2000; i++) {
+        std::string p = "p" + std::to_string(rng() % 900);
+        size_t amount = rng() % 9;
+        T.sell(p, amount);
+        L.sell(p, amount);
+    }
+    for (size_t r = 1; r <= T.products(); r++)
+        assert(L.sold(r) == T.sold(r) && L.sold(1, r) == T.sold(1, r));
+
+    std::stringstream truncated(stream.str().substr(0, stream.str().size() / 2));
+    try {
+        L.load(truncated);
+        assert("Missing exception" == nullptr);
+    } catch (const std::invalid_argument &e) {
+    }
+    assert(L.products() == T.products());
+
+    // The first bucket starts after the header and the counts, its product count is followed by the first length
+    std::string corrupted = stream.str();
+    uint64_t huge = uint64_t(1) << 62;
+    corrupted.replace(40, sizeof(huge), reinterpret_cast<const char *>(&huge), sizeof(huge));
+    std::stringstream corrupted_length(corrupted);
+    try {
+        L.load(corrupted_length);
+        assert("Missing exception" == nullptr);
+    } catch (const std::invalid_argument &e) {
+    }
+    assert(L.products() == T.products());
+
+    Bestsellers<int> B;
+    B.bulkLoad(std::vector<std::pair<int, size_t>>{{4, 1}, {7, 1}, {3, 2}, {9, 6}});
+    assert(B.product(1) == 9 && B.rank(3) == 2 && B.sold(2, 4) == 4);
+    assert(B.firstSame(3) == 3 && B.lastSame(3) == 4);
+    std::stringstream ints;
+    B.save(ints);
+    Bestsellers<int> C;
+    C.load(ints);
+    assert(C.sold(1, 4) == 10 && C.rank(9) == 1 && C.rank(3) == 2);
+    for (size_t offset: {16, 32}) {
+        // A huge number of products, first in the header and then in the first bucket
+        std::string bad_count = ints.str();
+        uint64_t count = offset == 16 ? uint64_t(1) << 60 : (uint64_t(1) << 31) - 1;
+        bad_count.replace(offset, sizeof(count), reinterpret_cast<const char *>(&count), sizeof(count));
+        std::stringstream bad(bad_count);
+        try {
+            C.load(bad);
+            assert("Missing exception" == nullptr);
+        } catch (const std::invalid_argument &e) {
+        }
+        assert(C.products() == 4 && C.rank(9) == 1);
+    }
+    try {
+        B.bulkLoad(std::vector<std::pair<int, size_t>>{{4, 2}, {7, 1}});
+        assert("Missing exception" == nullptr);
+    } catch (const std::invalid_argument &e) {
+    }
+}
+
+/**
+ * Test case 8: A windowed tracker matches the sales of a brute force model that fall within the window.
+ */
+void test8() {
+    WindowedBestsellers<int> W(60, 10);
+    std::vector<std::tuple<uint64_t, int, size_t>> log;
+    std::mt19937 rng(17);
+    uint64_t time = 0;
+    for (int i = 0; i < 20000; i++) {
+        time += rng() % 3;
+        uint64_t sale_time = time - std::min<uint64_t>(time, rng() % 4 ? 0 : rng() % 80); // Some sales come late
+        int p = (int) (rng() % 150);
+        size_t amount = rng() % 5;
+        W.sell(p, amount, sale_time);
+        log.emplace_back(sale_time, p, amount);
+
+        if (i % 97)
+            continue;
+        std::unordered_map<int, size_t> expected;
+        for (const auto &[t, product, a]: log)
+            if (a && t - t % 10 + 60 > W.now)
+                expected[product] += a;
+        assert(W.products() == expected.size());
+        std::vector<size_t> amounts;
+        for (const auto &[product, a]: expected) {
+            amounts.push_back(a);
+            assert(W.sold(W.rank(product)) == a);
+        }
+        std::sort(amounts.rbegin(), amounts.rend());
+        size_t prefix = 0;
+        for (size_t r = 1; r <= amounts.size(); r++) {
+            prefix += amounts[r - 1];
+            assert(W.sold(r) == amounts[r - 1] && W.sold(1, r) == prefix);
+        }
+    }
+    W.advance(time + 70);
+    assert(W.products() == 0 && W.buckets.empty());
+
+    Bestsellers<int> T;
+    T.sell(1, 5);
+    T.sell(2, 3);
+    T.withdraw(1, 3);
+    assert(T.rank(2) == 1 && T.sold(2) == 2);
+    T.withdraw(1, 2);
+    assert(T.products() == 1);
+    try {
+        T.withdraw(2, 4);
+        assert("Missing exception" == nullptr);
+    } catch (const std::out_of_range &e) {
+    }
+}
+
+/**
+ * Test case 9: Interned products rank the same as std::string products and are looked up by views.
+ */
+void test9() {
+    InternedBestsellers<> I;
+    Bestsellers<std::string> T;
+    std::mt19937 rng(19);
+    for (int i = 0; i < 6000; i++) {
+        std::string p = "sku-" + std::to_string(rng() % 500);
+        size_t amount = rng() % 7;
+        I.sell(p, amount);
+        T.sell(p, amount);
+    }
+    std::vector<std::pair<std::string, size_t>> batch;
+    for (int i = 0; i < 3000; i++)
+        batch.emplace_back("sku-" + std::to_string(rng() % 600), rng() % 4);
+    I.sellBatch(batch);
+    T.sellBatch(batch);
+
+    assert(I.products() == T.products() && I.interner.names.size() == T.products());
+    for (size_t r = 1; r <= T.products(); r++) {
+        assert(I.sold(r) == T.sold(r) && I.sold(1, r) == T.sold(1, r));
+        assert(T.sold(T.rank(I.product(r))) == T.sold(r));
+        assert(I.rank(I.product(r)) == r);
+        assert(I.firstSame(r) == T.firstSame(r) && I.lastSame(r) == T.lastSame(r));
+    }
+
+    char buffer[] = "sku-42 and more";
+    std::string_view view(buffer, 6);
+    assert(I.sold(I.rank(view)) == T.sold(T.rank("sku-42")));
+    I.withdraw(view, I.sold(I.rank(view)));
+    assert(I.products() == T.products() - 1);
+    try {
+        I.rank("sku-1000");
+        assert("Missing exception" == nullptr);
+    } catch (const std::out_of_range &e) {
+    }
+}
+
+/**
+ * Test case 10: Global queries over shards match a single tree, also after parallel batches.
+ */
+void test10() {
+    ShardedBestsellers<int> S(4);
+    auto category = [](int p, size_t shards) { return (size_t) p % shards; };
+    ShardedBestsellers<int, decltype(category), CBTreeBackend> C(3, category);
+    Bestsellers<int> T;
+    std::mt19937 rng(23);
+    for (int round = 0; round < 8; round++) {
+        std::vector<std::pair<int, size_t>> batch;
+        for (int i = 0; i < 1500; i++)
+            batch.emplace_back((int) (rng() % 900), rng() % 6);
+        if (round % 2)
+            for (const auto &[p, amount]: batch) {
+                S.sell(p, amount);
+                C.sell(p, amount);
+            }
+        else {
+            S.sellBatch(batch);
+            C.sellBatch(batch);
+        }
+        T.sellBatch(batch);
+
+        assert(S.products() == T.products() && C.products() == T.products());
+        for (size_t r = 1; r <= T.products(); r += 1 + rng() % 7) {
+            assert(S.sold(r) == T.sold(r) && C.sold(r) == T.sold(r));
+            assert(S.rank(S.product(r)) == r && C.rank(C.product(r)) == r);
+            assert(S.firstSame(r) == T.firstSame(r) && S.lastSame(r) == T.lastSame(r));
+            assert(C.firstSame(r) == T.firstSame(r) && C.lastSame(r) == T.lastSame(r));
+            size_t to = r + rng() % (T.products() - r + 1);
+            assert(S.sold(r, to) == T.sold(r, to) && C.sold(r, to) == T.sold(r, to));
+            int p = S.product(r);
+            assert(T.sold(T.rank(p)) == S.sold(r));
+            assert(C.localRank(p) == C.shards[(size_t) p % 3].tree.rank(p));
+        }
+    }
+    try {
+        S.product(S.products() + 1);
+        assert("Missing exception" == nullptr);
+    } catch (const std::out_of_range &e) {
+    }
+}
+
 /**
  * Main function to run the test cases.
  * @return 0 if all tests pass
@@ -587,6 +3072,15 @@ void test2() {
 int main() {
     test1();
     test2();
+    test3<Bestsellers<int>>();
+    test3<Bestsellers<int, CBTreeBackend>>();
+    test4();
+    test5();
+    test6();
+    test7();
+    test8();
+    test9();
+    test10();
 }
 
 #endif
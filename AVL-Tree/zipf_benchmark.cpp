@@ -0,0 +1,227 @@
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <stdexcept>
+#include <type_traits>
+#include <functional>
+#include <memory>
+#include <limits>
+#include <optional>
+#include <algorithm>
+#include <bitset>
+#include <list>
+#include <array>
+#include <vector>
+#include <deque>
+#include <unordered_set>
+#include <unordered_map>
+#include <stack>
+#include <queue>
+#include <random>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+
+// The tracker is compiled the same way as by the evaluator, without its tests and main
+#define __PROGTEST__
+#include "main.cpp"
+
+using Clock = std::chrono::steady_clock;
+
+// Every LATENCY_SAMPLE-th operation is timed on its own, the others run back to back
+constexpr size_t LATENCY_SAMPLE = 16;
+
+// Exponent of the Zipf distribution of the sales
+constexpr double ZIPF_EXPONENT = 1.0;
+
+/**
+ * Function to generate a stream of product indices following a Zipf distribution. The most popular products
+ * get random indices, so popularity is not correlated with the order of the catalogue.
+ * @param catalogue Number of distinct products
+ * @param length Length of the stream
+ * @param seed Seed of the random generator
+ * @return The generated indices
+ */
+std::vector<uint32_t> generateZipf(size_t catalogue, size_t length, unsigned seed) {
+    std::mt19937_64 rng(seed);
+    std::vector<double> cdf(catalogue);
+    double total = 0;
+    for (size_t i = 0; i < catalogue; i++)
+        cdf[i] = total += 1 / std::pow((double) (i + 1), ZIPF_EXPONENT);
+    std::vector<uint32_t> popularity(catalogue);
+    for (size_t i = 0; i < catalogue; i++)
+        popularity[i] = (uint32_t) i;
+    std::shuffle(popularity.begin(), popularity.end(), rng);
+
+    std::uniform_real_distribution<double> uniform(0, total);
+    std::vector<uint32_t> stream(length);
+    for (auto &index: stream) {
+        size_t position = std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin();
+        index = popularity[std::min(position, catalogue - 1)];
+    }
+    return stream;
+}
+
+/**
+ * Function to create the product with a given index.
+ * @param index Index of the product
+ * @return The product
+ */
+template<typename Product>
+Product makeProduct(uint32_t index);
+
+template<>
+int makeProduct<int>(uint32_t index) {
+    return (int) index;
+}
+
+template<>
+std::string makeProduct<std::string>(uint32_t index) {
+    std::string number = std::to_string(index);
+    return "SKU-" + std::string(10 - number.size(), '0') + number;
+}
+
+// Throughput and sampled latencies of one kind of operation
+struct CMeasurement {
+    double seconds = 0; // Time of all operations
+    size_t operations = 0; // Number of operations
+    std::vector<uint32_t> latencies; // Nanoseconds taken by the sampled operations
+};
+
+/**
+ * Function to run an operation a given number of times, timing every LATENCY_SAMPLE-th call separately.
+ * @param operations Number of calls
+ * @param operation Callable taking the index of the call
+ * @return The measurement
+ */
+template<typename Operation>
+CMeasurement measureOperation(size_t operations, Operation &&operation) {
+    CMeasurement result;
+    result.operations = operations;
+    result.latencies.reserve(operations / LATENCY_SAMPLE + 1);
+    auto start = Clock::now();
+    for (size_t i = 0; i < operations; i++) {
+        if (i % LATENCY_SAMPLE) {
+            operation(i);
+            continue;
+        }
+        auto before = Clock::now();
+        operation(i);
+        result.latencies.push_back(
+                (uint32_t) std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - before).count());
+    }
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return result;
+}
+
+/**
+ * Function to get a percentile of the sampled latencies.
+ * @param latencies The latencies, reordered by the call
+ * @param percentile The percentile, between 0 and 100
+ * @return The latency in nanoseconds
+ */
+uint32_t percentile(std::vector<uint32_t> &latencies, size_t percentile) {
+    if (latencies.empty())
+        return 0;
+    size_t position = std::min(latencies.size() - 1, latencies.size() * percentile / 100);
+    std::nth_element(latencies.begin(), latencies.begin() + position, latencies.end());
+    return latencies[position];
+}
+
+/**
+ * Function to print one row of the results.
+ * @param catalogue Number of distinct products
+ * @param type Name of the product type
+ * @param name Name of the operation
+ * @param measurement The measurement
+ */
+void report(size_t catalogue, const char *type, const char *name, CMeasurement &measurement) {
+    std::cout << std::setw(10) << catalogue << std::setw(8) << type << std::setw(12) << name
+              << std::setw(14) << (size_t) (measurement.operations / measurement.seconds)
+              << std::setw(10) << percentile(measurement.latencies, 50)
+              << std::setw(10) << percentile(measurement.latencies, 99) << std::endl;
+}
+
+/**
+ * Function to drive a tracker with a Zipf-distributed sale stream and measure its operations.
+ * @param catalogue Number of distinct products
+ * @param stream Indices of the sold products
+ * @param type Name of the product type
+ */
+template<typename Product, typename Tracker = Bestsellers<Product>>
+void benchmarkZipf(size_t catalogue, const std::vector<uint32_t> &stream, const char *type) {
+    std::vector<Product> products(catalogue);
+    for (size_t i = 0; i < catalogue; i++)
+        products[i] = makeProduct<Product>((uint32_t) i);
+    std::mt19937 rng(7);
+    std::vector<size_t> amounts(stream.size());
+    for (auto &amount: amounts)
+        amount = rng() % 3 + 1;
+
+#ifdef BESTSELLERS_STATS
+    bestsellers_stats = CBestsellersStats();
+#endif
+    Tracker tracker;
+    CMeasurement sell = measureOperation(stream.size(), [&](size_t i) {
+        tracker.sell(products[stream[i]], amounts[i]);
+    });
+    report(catalogue, type, "sell", sell);
+#ifdef BESTSELLERS_STATS
+    std::cout << std::setw(18) << "" << "rotations " << bestsellers_stats.rotations
+              << ", node allocations " << bestsellers_stats.allocations
+              << ", reuses " << bestsellers_stats.reuses
+              << ", releases " << bestsellers_stats.releases
+              << ", b+-tree splits " << bestsellers_stats.splits
+              << ", compactions " << bestsellers_stats.compactions << std::endl;
+#endif
+
+    // Ranks are asked for sold products with the popularity of the stream, the ranges are uniform
+    size_t queries = std::min<size_t>(stream.size(), 1000000);
+    size_t n = tracker.products();
+    std::vector<size_t> ranks(queries);
+    for (auto &r: ranks)
+        r = rng() % n + 1;
+    size_t sink = 0;
+    CMeasurement rank = measureOperation(queries, [&](size_t i) {
+        sink += tracker.rank(products[stream[stream.size() - 1 - i]]);
+    });
+    report(catalogue, type, "rank", rank);
+    CMeasurement product = measureOperation(queries, [&](size_t i) {
+        sink += (size_t) &tracker.product(ranks[i]);
+    });
+    report(catalogue, type, "product", product);
+    CMeasurement sold = measureOperation(queries, [&](size_t i) {
+        sink += tracker.sold(ranks[i] / 2 + 1, ranks[i]);
+    });
+    report(catalogue, type, "sold range", sold);
+    if (sink == std::numeric_limits<size_t>::max())
+        std::cout << sink << std::endl;
+}
+
+/**
+ * Main function to run the benchmark on catalogues of 10^4 products up to a given size.
+ * @param argc Number of arguments
+ * @param argv The largest catalogue can be given as the first argument, 1000000 by default
+ * @return 0
+ */
+int main(int argc, char **argv) {
+    size_t largest = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    std::cout << "Zipf-distributed sales, two sales per product of the catalogue, latencies in ns" << std::endl;
+    std::cout << std::setw(10) << "products" << std::setw(8) << "type" << std::setw(12) << "operation"
+              << std::setw(14) << "ops/s" << std::setw(10) << "p50" << std::setw(10) << "p99" << std::endl;
+    for (size_t catalogue = 10000; catalogue <= largest; catalogue *= 10) {
+        auto stream = generateZipf(catalogue, 2 * catalogue, 1);
+        benchmarkZipf<int>(catalogue, stream, "int");
+        benchmarkZipf<int, Bestsellers<int, CBTreeBackend>>(catalogue, stream, "btree");
+        benchmarkZipf<std::string>(catalogue, stream, "string");
+        benchmarkZipf<std::string, InternedBestsellers<>>(catalogue, stream, "intern");
+    }
+    return 0;
+}
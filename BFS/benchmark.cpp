@@ -0,0 +1,459 @@
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <limits>
+#include <optional>
+#include <algorithm>
+#include <bitset>
+#include <list>
+#include <array>
+#include <vector>
+#include <deque>
+#include <set>
+#include <map>
+#include <unordered_set>
+#include <unordered_map>
+#include <stack>
+#include <queue>
+#include <random>
+#include <cmath>
+#include <stdexcept>
+#include <variant>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <tuple>
+#include <string>
+#include <fstream>
+#include <cstdlib>
+
+using Place = size_t; // Type alias for place identifier
+
+// Structure representing the map, including places, connections, and items
+struct Map
+{
+    size_t places; // Total number of places
+    Place start, end; // Starting and ending places
+    std::vector<std::pair<Place, Place>> connections; // Vector of connections between places
+    std::vector<std::vector<Place>> items; // Vector of items located in different places
+};
+
+// Hash specialization for std::pair to use it as a key in unordered_map/unordered_set
+template <typename F, typename S>
+struct std::hash<std::pair<F, S>>
+{
+    std::size_t operator()(const std::pair<F, S> &p) const noexcept
+    {
+        return std::hash<F>()(p.first) ^ (std::hash<S>()(p.second) << 1);
+    }
+};
+
+// The pathfinding is compiled the same way as by the evaluator, without its tests and main
+#define __PROGTEST__
+#include "main.cpp"
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * Function to put item groups on random places of a map.
+ * @param map The map
+ * @param groups Number of item groups
+ * @param multiplicity Number of places of every item group
+ * @param rng The random generator
+ */
+void addItems(Map &map, size_t groups, size_t multiplicity, std::mt19937 &rng)
+{
+    map.items.resize(groups);
+    for (auto &group : map.items)
+        for (size_t i = 0; i < multiplicity; i++)
+            group.push_back(rng() % map.places);
+}
+
+/**
+ * Function to generate a grid of places with the start and the end in opposite corners.
+ * @param width Number of places in a row
+ * @param height Number of rows
+ * @param groups Number of item groups
+ * @param multiplicity Number of places of every item group
+ * @param seed Seed of the random generator
+ * @return The generated map
+ */
+Map generateGrid(size_t width, size_t height, size_t groups, size_t multiplicity, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    Map map{width * height, 0, width * height - 1, {}, {}};
+    for (size_t y = 0; y < height; y++)
+        for (size_t x = 0; x < width; x++)
+        {
+            if (x + 1 < width)
+                map.connections.emplace_back(y * width + x, y * width + x + 1);
+            if (y + 1 < height)
+                map.connections.emplace_back(y * width + x, (y + 1) * width + x);
+        }
+    addItems(map, groups, multiplicity, rng);
+    return map;
+}
+
+/**
+ * Function to generate a random geometric graph: places at random points of the unit square, connected when they
+ * are closer than the radius that gives the requested average degree. The start and the end are the places closest
+ * to opposite corners.
+ * @param places Number of places
+ * @param degree Average number of neighbours of a place
+ * @param groups Number of item groups
+ * @param multiplicity Number of places of every item group
+ * @param seed Seed of the random generator
+ * @return The generated map
+ */
+Map generateGeometric(size_t places, double degree, size_t groups, size_t multiplicity, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> coordinate(0.0, 1.0);
+    std::vector<std::pair<double, double>> points(places);
+    for (auto &point : points)
+        point = {coordinate(rng), coordinate(rng)};
+    double radius = std::sqrt(degree / (std::acos(-1.0) * (double)places));
+
+    // Cells at least as wide as the radius, so close places are in the same or a neighbouring cell
+    size_t cells = std::max<size_t>(1, (size_t)(1.0 / radius));
+    auto cellOf = [cells](double c) { return std::min(cells - 1, (size_t)(c * (double)cells)); };
+    std::vector<std::vector<Place>> grid(cells * cells);
+    for (Place p = 0; p < places; p++)
+        grid[cellOf(points[p].second) * cells + cellOf(points[p].first)].push_back(p);
+
+    Map map{places, 0, 0, {}, {}};
+    for (Place p = 0; p < places; p++)
+    {
+        size_t x = cellOf(points[p].first), y = cellOf(points[p].second);
+        for (size_t ny = y ? y - 1 : 0; ny <= std::min(cells - 1, y + 1); ny++)
+            for (size_t nx = x ? x - 1 : 0; nx <= std::min(cells - 1, x + 1); nx++)
+                for (const auto &q : grid[ny * cells + nx])
+                {
+                    double dx = points[p].first - points[q].first, dy = points[p].second - points[q].second;
+                    if (p < q && dx * dx + dy * dy < radius * radius)
+                        map.connections.emplace_back(p, q);
+                }
+        if (points[p].first + points[p].second < points[map.start].first + points[map.start].second)
+            map.start = p;
+        if (points[p].first + points[p].second > points[map.end].first + points[map.end].second)
+            map.end = p;
+    }
+    addItems(map, groups, multiplicity, rng);
+    return map;
+}
+
+/**
+ * Function to generate a scale-free graph by preferential attachment: every new place is connected to a few earlier
+ * places chosen with probability proportional to their degree, which gives a few hubs and many places of low degree.
+ * @param places Number of places
+ * @param links Number of connections of every new place
+ * @param groups Number of item groups
+ * @param multiplicity Number of places of every item group
+ * @param seed Seed of the random generator
+ * @return The generated map
+ */
+Map generateScaleFree(size_t places, size_t links, size_t groups, size_t multiplicity, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    Map map{places, 0, 0, {}, {}};
+    std::vector<Place> ends; // Every place once per connection, so a uniform pick prefers hubs
+    for (Place p = 1; p < places; p++)
+    {
+        std::set<Place> chosen;
+        while (chosen.size() < std::min<size_t>(links, p))
+            chosen.insert(ends.empty() ? rng() % p : ends[rng() % ends.size()]);
+        for (const auto &q : chosen)
+        {
+            map.connections.emplace_back(q, p);
+            ends.push_back(q);
+            ends.push_back(p);
+        }
+    }
+    map.start = rng() % places;
+    map.end = rng() % places;
+    addItems(map, groups, multiplicity, rng);
+    return map;
+}
+
+/**
+ * Function to reset the peak resident memory of the process to the current one, which only Linux supports.
+ */
+void resetPeakMemory()
+{
+    std::ofstream("/proc/self/clear_refs") << "5";
+}
+
+/**
+ * Function to get a memory figure of the process from /proc/self/status.
+ * @param key Name of the figure, VmRSS for the current resident memory or VmHWM for its peak since the last reset
+ * @return The figure in MB, 0 if the system does not report it
+ */
+double memory(const std::string &key)
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+        if (line.rfind(key + ":", 0) == 0)
+            return std::stod(line.substr(key.size() + 1)) / 1024;
+    return 0;
+}
+
+/**
+ * Function to generate a long corridor with a few side rooms holding the items.
+ * @param length Number of places of the corridor
+ * @param groups Number of item groups
+ * @param seed Seed of the random generator
+ * @return The generated map
+ */
+Map generateCorridor(size_t length, size_t groups, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    Map map{length + groups, 0, length - 1, {}, {}};
+    for (size_t i = 0; i + 1 < length; i++)
+        map.connections.emplace_back(i, i + 1);
+    for (size_t g = 0; g < groups; g++)
+    {
+        map.connections.emplace_back(rng() % length, length + g);
+        map.items.push_back({length + g});
+    }
+    return map;
+}
+
+// Names of the search modes
+const std::vector<std::pair<SearchMode, const char *>> ALL_MODES = {
+        {SearchMode::BFS, "bfs"}, {SearchMode::BIDIRECTIONAL, "bidirectional"}, {SearchMode::A_STAR, "a*"},
+        {SearchMode::HELD_KARP, "held-karp"}, {SearchMode::PARALLEL_BFS, "parallel bfs"}};
+
+/**
+ * Function to print the header of the table of benchmarkModes.
+ */
+void printModesHeader()
+{
+    std::cout << std::setw(28) << "map" << std::setw(14) << "mode" << std::setw(10) << "length"
+              << std::setw(10) << "seconds" << std::setw(10) << "peak MB" << std::endl;
+}
+
+/**
+ * Function to time find_path in the given search modes on one map, with the peak memory each search added.
+ * @param name Name of the map
+ * @param map The map
+ * @param modes The search modes, all of them by default
+ */
+void benchmarkModes(const char *name, const Map &map,
+                    const std::vector<std::pair<SearchMode, const char *>> &modes = ALL_MODES)
+{
+    std::optional<size_t> expected;
+    std::vector<Place> path;
+    for (const auto &[mode, mode_name] : modes)
+    {
+#ifdef BFS_STATS
+        path_stats = CPathStats();
+#endif
+        resetPeakMemory();
+        double resident = memory("VmRSS");
+        auto start = Clock::now();
+        find_path(map, mode, path);
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        double peak = memory("VmHWM") - resident; // What the search added to the map and the earlier searches
+        if (!expected)
+            expected = path.size();
+        assert(path.size() == *expected);
+        std::cout << std::setw(28) << name << std::setw(14) << mode_name << std::setw(10) << path.size()
+                  << std::setw(10) << std::fixed << std::setprecision(3) << seconds << std::setw(10)
+                  << std::setprecision(1) << peak << std::endl;
+#ifdef BFS_STATS
+        std::cout << std::setw(28) << "" << "expanded " << path_stats.expanded << ", visited " << path_stats.visited
+                  << ", place searches " << path_stats.place_searches << std::endl;
+#endif
+    }
+}
+
+/**
+ * Function to time many queries between random places of one map, each one preparing the map again and in batches
+ * on a prepared map with different numbers of threads.
+ * @param name Name of the map
+ * @param map The map
+ * @param query_cnt Number of queries
+ */
+void benchmarkBatch(const char *name, const Map &map, size_t query_cnt)
+{
+    std::mt19937 rng(7);
+    std::vector<std::pair<Place, Place>> queries;
+    for (size_t i = 0; i < query_cnt; i++)
+        queries.emplace_back(rng() % map.places, rng() % map.places);
+
+    auto start = Clock::now();
+    std::vector<std::list<Place>> expected;
+    for (const auto &[from, to] : queries)
+    {
+        Map single = map;
+        single.start = from;
+        single.end = to;
+        expected.push_back(find_path(single));
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    std::cout << std::setw(28) << name << std::setw(14) << "unprepared" << std::setw(10) << query_cnt
+              << std::setw(10) << std::fixed << std::setprecision(3) << seconds << std::endl;
+
+    std::vector<std::vector<Place>> paths;
+    for (size_t threads : {size_t(1), size_t(std::max(1u, std::thread::hardware_concurrency()))})
+    {
+        start = Clock::now();
+        find_paths(PreparedMap(map), queries, paths, threads);
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        for (size_t i = 0; i < paths.size(); i++)
+            assert(paths[i].size() == expected[i].size());
+        std::cout << std::setw(28) << name << std::setw(14) << (std::to_string(threads) + " threads")
+                  << std::setw(10) << query_cnt << std::setw(10) << std::fixed << std::setprecision(3) << seconds
+                  << std::endl;
+    }
+
+}
+
+/**
+ * Function to time many small batches of queries on 4 threads, once starting the threads for every batch with
+ * find_paths and once keeping them in one QueryPool.
+ * @param name Name of the map
+ * @param map The map
+ * @param batch_cnt Number of batches
+ * @param batch_size Number of queries of a batch
+ */
+void benchmarkPool(const char *name, const Map &map, size_t batch_cnt, size_t batch_size)
+{
+    std::mt19937 rng(9);
+    std::vector<std::vector<std::pair<Place, Place>>> batches(batch_cnt);
+    for (auto &batch : batches)
+        for (size_t i = 0; i < batch_size; i++)
+            batch.emplace_back(rng() % map.places, rng() % map.places);
+    PreparedMap prepared(map);
+    std::vector<std::vector<Place>> paths;
+
+    auto start = Clock::now();
+    for (const auto &batch : batches)
+        find_paths(prepared, batch, paths, 4);
+    double fresh = std::chrono::duration<double>(Clock::now() - start).count();
+
+    start = Clock::now();
+    QueryPool pool(4);
+    for (const auto &batch : batches)
+        pool.find_paths(prepared, batch, paths);
+    double pooled = std::chrono::duration<double>(Clock::now() - start).count();
+
+    for (const auto &[batch, seconds] : {std::make_pair("new threads", fresh), std::make_pair("pool", pooled)})
+        std::cout << std::setw(28) << name << std::setw(14) << batch << std::setw(10) << batch_cnt * batch_size
+                  << std::setw(10) << std::fixed << std::setprecision(3) << seconds << std::endl;
+}
+
+/**
+ * Function to give the connections of a map random lengths.
+ * @param map The map
+ * @param longest The longest length, 1 for the same length of all connections
+ * @param seed Seed of the random generator
+ * @return The map with lengths
+ */
+WeightedMap withLengths(const Map &map, uint32_t longest, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    WeightedMap weighted{map.places, map.start, map.end, {}, map.items};
+    for (const auto &[a, b] : map.connections)
+        weighted.connections.emplace_back(a, b, 1 + rng() % longest);
+    return weighted;
+}
+
+/**
+ * Function to time find_path on a map with lengths of its connections.
+ * @param name Name of the map
+ * @param map The map
+ * @param lengths Description of the lengths
+ */
+void benchmarkWeighted(const char *name, const WeightedMap &map, const char *lengths)
+{
+    std::vector<Place> path;
+    auto start = Clock::now();
+    find_path(map, path);
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    std::cout << std::setw(28) << name << std::setw(14) << lengths << std::setw(10) << path.size() << std::setw(10)
+              << path_length(map, path).value_or(0) << std::setw(10) << std::fixed << std::setprecision(3) << seconds
+              << std::endl;
+}
+
+/**
+ * Main function to run the benchmark.
+ * @param argc Number of arguments
+ * @param argv Without arguments the default maps are timed. A single map is timed with the arguments kind (grid,
+ * geometric, scale-free or corridor), places, degree (neighbours of a geometric place, links of a new scale-free
+ * place), item groups, places per item group and an optional seed.
+ * @return 0, or 1 for wrong arguments
+ */
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        if (argc < 6)
+        {
+            std::cerr << "usage: " << argv[0] << " grid|geometric|scale-free|corridor places degree groups multiplicity"
+                      << " [seed]" << std::endl;
+            return 1;
+        }
+        std::string kind = argv[1];
+        size_t places = std::strtoull(argv[2], nullptr, 10);
+        double degree = std::strtod(argv[3], nullptr);
+        size_t groups = std::strtoull(argv[4], nullptr, 10);
+        size_t multiplicity = std::strtoull(argv[5], nullptr, 10);
+        unsigned seed = argc > 6 ? (unsigned)std::strtoul(argv[6], nullptr, 10) : 1;
+        Map map;
+        if (kind == "grid")
+        {
+            size_t width = std::max<size_t>(1, (size_t)std::sqrt((double)places));
+            map = generateGrid(width, width, groups, multiplicity, seed);
+        }
+        else if (kind == "geometric")
+            map = generateGeometric(places, degree, groups, multiplicity, seed);
+        else if (kind == "scale-free")
+            map = generateScaleFree(places, (size_t)degree, groups, multiplicity, seed);
+        else if (kind == "corridor")
+            map = generateCorridor(places, groups, seed);
+        else
+        {
+            std::cerr << "unknown kind of map " << kind << std::endl;
+            return 1;
+        }
+        printModesHeader();
+        benchmarkModes(kind.c_str(), map);
+        return 0;
+    }
+
+    printModesHeader();
+    benchmarkModes("corridor 10^6, 4 items", generateCorridor(1000000, 4, 1));
+    benchmarkModes("corridor 10^5, 10 items", generateCorridor(100000, 10, 2));
+    benchmarkModes("grid 1000x1000, 4 items", generateGrid(1000, 1000, 4, 3, 3));
+    benchmarkModes("grid 300x300, 10 items", generateGrid(300, 300, 10, 2, 4));
+    benchmarkModes("geometric 2*10^5, 6 items", generateGeometric(200000, 8, 6, 2, 9));
+    benchmarkModes("scale-free 2*10^5, 6 items", generateScaleFree(200000, 3, 6, 2, 10));
+    // Too many states for the searches, only the dynamic programming over the places holding items finishes
+    benchmarkModes("grid 1000x1000, 16 items", generateGrid(1000, 1000, 16, 1, 5),
+                   {{SearchMode::HELD_KARP, "held-karp"}});
+    // More groups than fit into 32 bits, spread over ten side rooms
+    Map wide = generateCorridor(100000, 10, 6);
+    for (size_t g = 10; g < 40; g++)
+        wide.items.push_back(wide.items[g % 10]);
+    benchmarkModes("corridor 10^5, 40 items", wide, {{SearchMode::HELD_KARP, "held-karp"}});
+
+    std::cout << std::endl << std::setw(28) << "map" << std::setw(14) << "lengths" << std::setw(10) << "places"
+              << std::setw(10) << "distance" << std::setw(10) << "seconds" << std::endl;
+    Map grid = generateGrid(300, 300, 8, 2, 11);
+    benchmarkWeighted("grid 300x300, 8 items", withLengths(grid, 1, 12), "all 1");
+    benchmarkWeighted("grid 300x300, 8 items", withLengths(grid, 9, 12), "1 to 9");
+    Map geometric = generateGeometric(200000, 8, 6, 2, 9);
+    benchmarkWeighted("geometric 2*10^5, 6 items", withLengths(geometric, 1, 13), "all 1");
+    benchmarkWeighted("geometric 2*10^5, 6 items", withLengths(geometric, 100, 13), "1 to 100");
+
+    std::cout << std::endl << std::setw(28) << "map" << std::setw(14) << "batch" << std::setw(10) << "queries"
+              << std::setw(10) << "seconds" << std::endl;
+    benchmarkBatch("grid 100x100, 4 items", generateGrid(100, 100, 4, 3, 8), 1000);
+    benchmarkPool("grid 10x10, 2 items", generateGrid(10, 10, 2, 1, 8), 10000, 10);
+    return 0;
+}
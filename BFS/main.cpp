@@ -17,6 +17,14 @@
 #include <unordered_map>
 #include <stack>
 #include <queue>
+#include <cmath>
+#include <stdexcept>
+#include <variant>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <tuple>
 
 using Place = size_t; // Type alias for place identifier
 
@@ -47,133 +55,1427 @@ struct std::hash<std::pair<F, S>>
 
 #endif
 
+// Structure representing a map whose connections have integer lengths, with places and items as in Map
+struct WeightedMap
+{
+    size_t places; // Total number of places
+    Place start, end; // Starting and ending places
+    std::vector<std::tuple<Place, Place, uint32_t>> connections; // Connections between places with their lengths
+    std::vector<std::vector<Place>> items; // Vector of items located in different places
+};
+
+#ifdef BFS_STATS
+// Counters of the work done by the searches of the program, for profiling only and not thread-safe
+struct CPathStats
+{
+    size_t expanded = 0; // States whose neighbours were generated
+    size_t visited = 0; // States stored as visited
+    size_t place_searches = 0; // Searches over the places alone, for distances and shortest paths
+};
+
+inline CPathStats path_stats;
+
+#define PATH_COUNT(counter, amount) (path_stats.counter += (amount))
+#else
+#define PATH_COUNT(counter, amount) ((void)0)
+#endif
+
 using bitmask = uint16_t; // Type alias for bitmask representation of collected items
 
-// Class representing the graph and performing the BFS to find the path
+constexpr size_t MAX_ITEM_GROUPS = 256; // Most item groups find_path accepts, with masks of std::bitset
+
+// Operations on the masks of collected item groups, for unsigned integers of any width
+template <typename Mask>
+struct CMaskTraits
+{
+    static Mask bit(size_t item) { return (Mask)(Mask(1) << item); }
+
+    static Mask full(size_t item_cnt)
+    {
+        return item_cnt >= (size_t)std::numeric_limits<Mask>::digits ? (Mask)~Mask(0) : (Mask)((Mask(1) << item_cnt) - 1);
+    }
+
+    static bool has(const Mask &mask, size_t item) { return (mask >> item) & 1; }
+
+    static size_t count(const Mask &mask) { return std::bitset<64>(mask).count(); }
+
+    static size_t index(const Mask &mask) { return (size_t)mask; }
+};
+
+// Operations on the masks of collected item groups stored in a std::bitset
+template <size_t N>
+struct CMaskTraits<std::bitset<N>>
+{
+    static std::bitset<N> bit(size_t item) { return std::bitset<N>().set(item); }
+
+    static std::bitset<N> full(size_t item_cnt)
+    {
+        std::bitset<N> mask;
+        for (size_t i = 0; i < item_cnt; i++)
+            mask.set(i);
+        return mask;
+    }
+
+    static bool has(const std::bitset<N> &mask, size_t item) { return mask.test(item); }
+
+    static size_t count(const std::bitset<N> &mask) { return mask.count(); }
+
+    static size_t index(const std::bitset<N> &mask) { return (size_t)mask.to_ullong(); }
+};
+
+constexpr uint32_t NO_PLACE = std::numeric_limits<uint32_t>::max(); // Predecessor of the starting state
+constexpr size_t DENSE_STATE_LIMIT = size_t(1) << 27; // Largest places * 2^items searched with flat arrays
+constexpr uint32_t UNREACHABLE = std::numeric_limits<uint32_t>::max(); // Distance to a place with no path to it
+constexpr size_t PARALLEL_GRAIN = 4096; // Fewest frontier states or scanned states worth a thread of their own
+constexpr size_t BOTTOM_UP_FACTOR = 14; // Bottom-up once the frontier edges times this exceed the unvisited edges
+
+// Search strategies of find_path, all of them return a shortest path
+enum class SearchMode
+{
+    BFS, // Breadth-first search from the start
+    BIDIRECTIONAL, // Breadth-first searches from the start and from the end meeting in the middle
+    A_STAR, // A* guided by the distances to the end through the missing item groups
+    HELD_KARP, // Dynamic programming over the places holding items, for state spaces too large to search
+    PARALLEL_BFS, // Level-synchronous breadth-first search over several threads, returns the same path as BFS
+    DIJKSTRA // Dijkstra's algorithm by the lengths of the connections of a WeightedMap, 1 for a Map
+};
+
+// Visited set and predecessors of the (place, mask) states stored in flat arrays indexed by place * 2^items + mask.
+// The visited bits are zeroed up front, the predecessor arrays are left uninitialised, so only the pages of the
+// states actually reached are ever touched.
+template <typename Mask = bitmask>
+struct CDenseStates
+{
+    size_t mask_cnt; // Number of masks per place, 2^items
+    std::vector<uint64_t> visited; // One bit per state
+    std::unique_ptr<uint32_t[]> pred_place; // Place of the predecessor of each visited state
+    std::unique_ptr<Mask[]> pred_mask; // Mask of the predecessor of each visited state
+
+    /**
+     * Constructor of the state arrays.
+     * @param places Number of places
+     * @param item_cnt Number of item groups
+     */
+    CDenseStates(size_t places, size_t item_cnt)
+        : mask_cnt(size_t(1) << item_cnt), visited((places * mask_cnt + 63) / 64),
+          pred_place(new uint32_t[places * mask_cnt]), pred_mask(new Mask[places * mask_cnt])
+    {
+    }
+
+    /**
+     * Function to mark a state as visited and remember its predecessor.
+     * @param place Place of the state
+     * @param mask Mask of the state
+     * @param from Place of the predecessor
+     * @param from_mask Mask of the predecessor
+     * @return True if the state was not visited before
+     */
+    bool insert(Place place, Mask mask, Place from, Mask from_mask)
+    {
+        size_t index = place * mask_cnt + CMaskTraits<Mask>::index(mask);
+        uint64_t bit = uint64_t(1) << (index % 64);
+        if (visited[index / 64] & bit)
+            return false;
+        visited[index / 64] |= bit;
+        pred_place[index] = (uint32_t)from;
+        pred_mask[index] = from_mask;
+        return true;
+    }
+
+    /**
+     * Function to get the predecessor of a visited state.
+     * @param place Place of the state
+     * @param mask Mask of the state
+     * @return The predecessor, with place NO_PLACE for the starting state
+     */
+    std::pair<Place, Mask> predecessor(Place place, Mask mask) const
+    {
+        size_t index = place * mask_cnt + CMaskTraits<Mask>::index(mask);
+        return {pred_place[index], pred_mask[index]};
+    }
+};
+
+// Visited set and predecessors of the (place, mask) states in a hash map, used when the flat arrays of
+// CDenseStates would not fit into memory
+template <typename Mask = bitmask>
+struct CHashedStates
+{
+    std::unordered_map<std::pair<Place, Mask>, std::pair<Place, Mask>> predators; // Maps current state to predecessor state in BFS
+
+    bool insert(Place place, Mask mask, Place from, Mask from_mask)
+    {
+        return predators.insert({{place, mask}, {from, from_mask}}).second;
+    }
+
+    std::pair<Place, Mask> predecessor(Place place, Mask mask) const
+    {
+        return predators.at({place, mask});
+    }
+};
+
+// Places holding items and the distances from each of them to all places, shared by the Held-Karp queries on one map
+struct CItemDistances
+{
+    std::vector<uint32_t> stops; // Places holding items
+    std::vector<std::vector<uint32_t>> between; // Distances from every stop to all places
+};
+
+// Priority queue for integer keys that never drop below the last key taken out, as in Dijkstra's algorithm. An entry
+// is kept in the bucket of the highest bit in which its key differs from the last key taken out, and moves to a lower
+// bucket only when its bucket is emptied, so every entry moves at most 64 times and nothing is compared.
+template <typename T>
+class CRadixHeap
+{
+public:
+    /**
+     * Function to add an entry.
+     * @param key Key of the entry, at least the last key taken out
+     * @param value The entry
+     */
+    void push(uint64_t key, const T &value)
+    {
+        buckets[bucketOf(key)].emplace_back(key, value);
+        size++;
+    }
+
+    /**
+     * Function to check if the queue is empty.
+     * @return True if there are no entries
+     */
+    bool empty() const
+    {
+        return size == 0;
+    }
+
+    /**
+     * Function to take out an entry with the smallest key.
+     * @return The key and the entry
+     */
+    std::pair<uint64_t, T> pop()
+    {
+        if (buckets[0].empty())
+        {
+            // The smallest key of the first non-empty bucket becomes the last key, its entries spread below
+            size_t i = 1;
+            while (buckets[i].empty())
+                i++;
+            last = std::min_element(buckets[i].begin(), buckets[i].end(),
+                                    [](const auto &a, const auto &b) { return a.first < b.first; })->first;
+            for (const auto &entry : buckets[i])
+                buckets[bucketOf(entry.first)].push_back(entry);
+            buckets[i].clear();
+        }
+        std::pair<uint64_t, T> entry = buckets[0].back();
+        buckets[0].pop_back();
+        size--;
+        return entry;
+    }
+
+private:
+    std::array<std::vector<std::pair<uint64_t, T>>, 65> buckets; // By the highest bit differing from last, plus one
+    uint64_t last = 0; // The last key taken out
+    size_t size = 0; // Number of entries
+
+    /**
+     * Function to get the bucket of a key.
+     * @param key The key
+     * @return Index of the bucket, 0 for the last key itself
+     */
+    size_t bucketOf(uint64_t key) const
+    {
+#ifdef __GNUC__
+        return key == last ? 0 : 64 - __builtin_clzll(key ^ last);
+#else
+        size_t bucket = 0;
+        for (uint64_t diff = key ^ last; diff; diff >>= 1)
+            bucket++;
+        return bucket;
+#endif
+    }
+};
+
+/**
+ * Function to split a range into parts and run a function on every part, each on its own thread. Ranges too small
+ * to be worth the threads are run on the calling thread as one part.
+ * @param size Size of the range
+ * @param thread_cnt Most threads to use, the calling thread included
+ * @param function Function called with the index of the part, its first and its past-the-end position
+ * @return Number of parts
+ */
+template <typename Function>
+size_t parallel_for(size_t size, size_t thread_cnt, const Function &function)
+{
+    size_t parts = std::max<size_t>(1, std::min(thread_cnt, size / PARALLEL_GRAIN));
+    std::vector<std::thread> threads;
+    for (size_t part = 1; part < parts; part++)
+        threads.emplace_back(function, part, size * part / parts, size * (part + 1) / parts);
+    function(0, 0, size / parts); // The calling thread takes the first part itself
+    for (auto &thread : threads)
+        thread.join();
+    return parts;
+}
+
+// Class representing the graph and performing the BFS to find the path, Mask holds one bit per item group
+template <typename Mask = bitmask>
 class Graph
 {
 public:
-    std::unordered_map<std::pair<Place, bitmask>, std::pair<Place, bitmask>> predators; // Maps current state to predecessor state in BFS
-    std::unordered_map<Place, std::vector<Place>> map_neighbours; // Maps each place to its neighbouring places
-    std::unordered_map<Place, std::vector<size_t>> item_location; // Maps each place to the items located there
-    std::unordered_map<size_t, bitmask> item_bitmask; // Maps each item to its corresponding bitmask
+    std::vector<size_t> offsets; // Neighbours of place p are targets[offsets[p]] up to targets[offsets[p + 1]]
+    std::vector<uint32_t> targets; // Neighbours of all places in compressed sparse row layout
+    std::vector<Mask> place_items; // Mask of the item groups located at each place
+
+    std::vector<uint32_t> weights; // Length of every connection in targets, empty for a Map without lengths
+
+    /**
+     * Constructor building the adjacency and the item masks of a map, and the lengths of the connections of a
+     * WeightedMap.
+     * @param map The map containing places, connections, and items
+     */
+    template <typename AnyMap>
+    explicit Graph(const AnyMap &map)
+    {
+        size_t places = std::max(map.places, std::max(map.start, map.end) + 1);
+        for (const auto &connection : map.connections)
+            places = std::max(places, std::max(std::get<0>(connection), std::get<1>(connection)) + 1);
+
+        // Count the degrees first, then place every neighbour right into its slot
+        offsets.assign(places + 1, 0);
+        for (const auto &connection : map.connections)
+        {
+            offsets[std::get<0>(connection) + 1]++;
+            offsets[std::get<1>(connection) + 1]++;
+        }
+        for (size_t i = 0; i < places; i++)
+            offsets[i + 1] += offsets[i];
+        targets.resize(offsets[places]);
+        constexpr bool weighted = std::tuple_size_v<typename decltype(map.connections)::value_type> == 3;
+        if constexpr (weighted)
+            weights.resize(offsets[places]);
+        std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+        for (const auto &connection : map.connections)
+        {
+            Place a = std::get<0>(connection), b = std::get<1>(connection);
+            if constexpr (weighted)
+            {
+                weights[next[a]] = std::get<2>(connection);
+                weights[next[b]] = std::get<2>(connection);
+            }
+            targets[next[a]++] = (uint32_t)b;
+            targets[next[b]++] = (uint32_t)a;
+        }
+
+        place_items.assign(places, Mask());
+        for (size_t item = 0; item < map.items.size(); item++)
+            for (const auto &place : map.items[item])
+                if (place < places)
+                    place_items[place] |= CMaskTraits<Mask>::bit(item);
+    }
+
+    /**
+     * Function to get the number of places of the graph.
+     * @return The number of places
+     */
+    size_t places() const
+    {
+        return place_items.size();
+    }
+
+    /**
+     * Function to write the path to a visited state by following the predecessors. The length of the path is known
+     * from the search, so the path is written from the back into a vector sized once.
+     * @param states Storage of the visited states and their predecessors
+     * @param place Place of the last state
+     * @param mask Mask of the last state
+     * @param edges Number of edges of the path
+     * @param found_path Vector the path is written to, from the start to the end
+     */
+    template <typename States>
+    static void backtrack(const States &states, Place place, Mask mask, size_t edges, std::vector<Place> &found_path)
+    {
+        found_path.resize(edges + 1);
+        std::pair<Place, Mask> state{place, mask};
+        for (size_t i = edges; i > 0; i--)
+        {
+            found_path[i] = state.first;
+            state = states.predecessor(state.first, state.second);
+        }
+        found_path[0] = state.first;
+    }
 
     /**
      * Function to perform a BFS search to find the shortest path that collects all items.
+     * @param states Storage of the visited states and their predecessors
      * @param item_cnt The total number of items
      * @param start The starting place in the map
      * @param end The target place in the map
-     * @param found_path Reference to a list to store the found path
+     * @param found_path Vector the found path is written to, from the start to the end
      * @return True if a path is found, false otherwise
      */
-    bool bfs(size_t item_cnt, Place start, Place end, std::list<Place> &found_path)
+    template <typename States>
+    bool bfs(States &states, size_t item_cnt, Place start, Place end, std::vector<Place> &found_path) const
     {
-        uint16_t strt_mask = 0; // Bitmask representing items collected at the start
-        uint16_t trgt_mask = 0; // Bitmask representing all items collected
+        Mask trgt_mask = CMaskTraits<Mask>::full(item_cnt); // Bitmask representing all items collected
+        Mask strt_mask = place_items[start]; // Bitmask representing items collected at the start
+        if (strt_mask == trgt_mask && start == end)
+        {
+            found_path.assign(1, start); // If all items are collected and we're already at the end, return
+            return true;
+        }
 
-        // Setting the target bitmask to represent all items
-        for (size_t i = 0; i < item_cnt; i++)
-            trgt_mask = (trgt_mask << 1) + 1;
+        std::vector<std::pair<uint32_t, Mask>> q; // Every state enters the queue once, so a vector is enough
+        size_t head = 0;
+        size_t level_end = 1; // The states before it are at most depth edges from the start
+        size_t depth = 0;
+        q.emplace_back((uint32_t)start, strt_mask); // Initialize the queue with the starting place and mask
+        states.insert(start, strt_mask, NO_PLACE, Mask()); // Mark the start as visited with a dummy predecessor
+        PATH_COUNT(visited, 1);
 
-        std::queue<std::pair<Place, bitmask>> q;
+        while (head < q.size())
+        {
+            if (head == level_end) // The states of the next level start here
+            {
+                depth++;
+                level_end = q.size();
+            }
+            auto [place, curr_mask] = q[head++]; // Current node and Mask of collected items
+            PATH_COUNT(expanded, 1);
 
-        // Check if the start place contains any items
-        if (item_location.count(start) != 0)
-            for (const auto &item : item_location[start])
+            // Explore neighbours of the current node
+            for (size_t i = offsets[place]; i < offsets[place + 1]; i++)
             {
-                strt_mask |= item_bitmask[item]; // Update the starting mask with the items found at the start
-                if (strt_mask == trgt_mask && start == end)
+                uint32_t nbr = targets[i];
+                Mask new_mask = (Mask)(curr_mask | place_items[nbr]); // Update the Mask with items found at the neighbour
+
+                if (!states.insert(nbr, new_mask, place, curr_mask)) // If the neighbour was visited with this Mask
+                    continue;
+                PATH_COUNT(visited, 1);
+                if (new_mask == trgt_mask && nbr == end) // If all items are collected and we're at the end
                 {
-                    found_path.push_back(start); // If all items are collected and we're already at the end, return
+                    backtrack(states, nbr, new_mask, depth + 1, found_path); // Backtrack to find the path
                     return true;
                 }
+                q.emplace_back(nbr, new_mask); // Continue exploring
             }
+        }
+        return false; // Return false if no path found
+    }
 
-        q.emplace(start, strt_mask); // Initialize the queue with the starting place and mask
-        predators.insert({{start, strt_mask}, {-1, -1}}); // Mark the start as visited with a dummy predecessor
+    /**
+     * Function to get the distances from a place to all places.
+     * @param from The place
+     * @return Number of edges to each place, UNREACHABLE if there is no path
+     */
+    std::vector<uint32_t> distances(Place from) const
+    {
+        PATH_COUNT(place_searches, 1);
+        std::vector<uint32_t> dist(places(), UNREACHABLE);
+        std::vector<uint32_t> q{(uint32_t)from};
+        dist[from] = 0;
+        for (size_t head = 0; head < q.size(); head++)
+            for (size_t i = offsets[q[head]]; i < offsets[q[head] + 1]; i++)
+                if (dist[targets[i]] == UNREACHABLE)
+                {
+                    dist[targets[i]] = dist[q[head]] + 1;
+                    q.push_back(targets[i]);
+                }
+        return dist;
+    }
 
-        while (!q.empty())
+    /**
+     * Function to get, for every place v, the length of the shortest walk from v through some place of an item
+     * group to the end, i.e. the minimum of d(v, l) + d(l, end) over the places l of the group. The walk starts
+     * at the places of the group at different distances, so the search is a BFS over buckets of distance.
+     * @param group Places of the item group
+     * @param to_end Distances of all places to the end
+     * @return The length for every place, UNREACHABLE if there is no such walk
+     */
+    std::vector<uint32_t> detourBound(const std::vector<Place> &group, const std::vector<uint32_t> &to_end) const
+    {
+        PATH_COUNT(place_searches, 1);
+        std::vector<uint32_t> bound(places(), UNREACHABLE);
+        std::vector<std::vector<uint32_t>> buckets;
+        for (const auto &place : group)
         {
-            uint16_t curr_mask = q.front().second; // Current bitmask of collected items
-            std::pair<Place, bitmask> node = q.front(); // Current node
-            q.pop();
+            if (place >= places() || to_end[place] == UNREACHABLE || to_end[place] >= bound[place])
+                continue;
+            bound[place] = to_end[place];
+            if (buckets.size() <= bound[place])
+                buckets.resize(bound[place] + 1);
+            buckets[bound[place]].push_back((uint32_t)place);
+        }
+        for (uint32_t d = 0; d < buckets.size(); d++)
+            for (size_t j = 0; j < buckets[d].size(); j++)
+            {
+                uint32_t place = buckets[d][j];
+                if (bound[place] != d)
+                    continue; // Reached again later with a smaller bound
+                for (size_t i = offsets[place]; i < offsets[place + 1]; i++)
+                    if (bound[targets[i]] > d + 1)
+                    {
+                        bound[targets[i]] = d + 1;
+                        if (buckets.size() <= d + 1)
+                            buckets.resize(d + 2);
+                        buckets[d + 1].push_back(targets[i]);
+                    }
+            }
+        return bound;
+    }
 
-            // Explore neighbours of the current node
-            for (const auto &nbr : map_neighbours[node.first])
+    /**
+     * Function to perform an A* search to find the shortest path that collects all items. The estimate of a state
+     * is the larger of the distance to the end and, over the groups still missing, the shortest walk to the end
+     * through the group. It never overestimates and drops by at most 1 per edge, so a state is final when it
+     * leaves the queue and is stored only then.
+     * @param states Storage of the visited states and their predecessors
+     * @param items The places of the item groups
+     * @param start The starting place in the map
+     * @param end The target place in the map
+     * @param found_path Vector the found path is written to, from the start to the end
+     * @return True if a path is found, false otherwise
+     */
+    template <typename States>
+    bool astar(States &states, const std::vector<std::vector<Place>> &items, Place start, Place end,
+               std::vector<Place> &found_path) const
+    {
+        Mask trgt_mask = CMaskTraits<Mask>::full(items.size());
+        std::vector<uint32_t> to_end = distances(end);
+        std::vector<std::vector<uint32_t>> bounds;
+        for (const auto &group : items)
+            bounds.push_back(detourBound(group, to_end));
+        auto estimate = [&](uint32_t place, Mask mask)
+        {
+            uint32_t h = to_end[place];
+            for (size_t g = 0; g < bounds.size(); g++)
+                if (!CMaskTraits<Mask>::has(mask, g))
+                    h = std::max(h, bounds[g][place]);
+            return h;
+        };
+
+        // Queued state with its predecessor, the states of one estimated length are kept in a stack so the
+        // deepest ones are expanded first
+        struct CEntry
+        {
+            uint32_t place, from;
+            Mask mask, from_mask;
+            uint32_t depth;
+        };
+        std::vector<std::vector<CEntry>> buckets;
+        auto push = [&](const CEntry &entry)
+        {
+            uint32_t h = estimate(entry.place, entry.mask);
+            if (h == UNREACHABLE)
+                return; // The end cannot be reached from here with all items
+            if (buckets.size() <= entry.depth + h)
+                buckets.resize(entry.depth + h + 1);
+            buckets[entry.depth + h].push_back(entry);
+        };
+        push({(uint32_t)start, NO_PLACE, place_items[start], Mask(), 0});
+
+        for (size_t f = 0; f < buckets.size(); f++)
+            while (!buckets[f].empty())
+            {
+                CEntry entry = buckets[f].back();
+                buckets[f].pop_back();
+                if (!states.insert(entry.place, entry.mask, entry.from, entry.from_mask))
+                    continue; // Already reached with a shorter path
+                PATH_COUNT(visited, 1);
+                if (entry.place == end && entry.mask == trgt_mask)
+                {
+                    backtrack(states, entry.place, entry.mask, entry.depth, found_path);
+                    return true;
+                }
+                PATH_COUNT(expanded, 1);
+                for (size_t i = offsets[entry.place]; i < offsets[entry.place + 1]; i++)
+                {
+                    uint32_t nbr = targets[i];
+                    push({nbr, entry.place, (Mask)(entry.mask | place_items[nbr]), entry.mask, entry.depth + 1});
+                }
+            }
+        return false;
+    }
+
+    /**
+     * Function to perform Dijkstra's algorithm over the (place, mask) states to find the shortest path by the lengths
+     * of the connections that collects all items. The lengths are integers, so the queue is a radix heap. A state is
+     * final when it leaves the queue and is stored only then, as in astar.
+     * @param states Storage of the visited states and their predecessors
+     * @param item_cnt The total number of items
+     * @param start The starting place in the map
+     * @param end The target place in the map
+     * @param found_path Vector the found path is written to, from the start to the end
+     * @return True if a path is found, false otherwise
+     */
+    template <typename States>
+    bool dijkstra(States &states, size_t item_cnt, Place start, Place end, std::vector<Place> &found_path) const
+    {
+        Mask trgt_mask = CMaskTraits<Mask>::full(item_cnt);
+
+        // Queued state with its predecessor and the number of connections to it
+        struct CEntry
+        {
+            uint32_t place, from;
+            Mask mask, from_mask;
+            uint32_t depth;
+        };
+        CRadixHeap<CEntry> heap;
+        heap.push(0, {(uint32_t)start, NO_PLACE, place_items[start], Mask(), 0});
+
+        while (!heap.empty())
+        {
+            auto [distance, entry] = heap.pop();
+            if (!states.insert(entry.place, entry.mask, entry.from, entry.from_mask))
+                continue; // Already reached by a shorter path
+            PATH_COUNT(visited, 1);
+            if (entry.place == end && entry.mask == trgt_mask)
             {
-                uint16_t new_mask = curr_mask;
-                if (item_location.count(nbr))
-                    for (const auto &item : item_location[nbr])
-                        new_mask |= item_bitmask[item]; // Update the bitmask with items found at the neighbour
+                backtrack(states, entry.place, entry.mask, entry.depth, found_path);
+                return true;
+            }
+            PATH_COUNT(expanded, 1);
+            for (size_t i = offsets[entry.place]; i < offsets[entry.place + 1]; i++)
+            {
+                uint32_t nbr = targets[i];
+                heap.push(distance + (weights.empty() ? 1 : weights[i]),
+                          {nbr, entry.place, (Mask)(entry.mask | place_items[nbr]), entry.mask, entry.depth + 1});
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Function to perform a bidirectional BFS to find the shortest path that collects all items. The forward
+     * search tracks the items collected since the start, the backward search the items collected on the way from
+     * a place to the end. The searches meet at a place reached by both with masks that together hold all items.
+     * The smaller non-empty frontier is expanded a whole level at a time and the search stops once the best meeting
+     * is not longer than the sum of the two finished depths, as every shorter path would have met by then.
+     * @param forward Storage of the states of the forward search
+     * @param backward Storage of the states of the backward search
+     * @param item_cnt The total number of items
+     * @param start The starting place in the map
+     * @param end The target place in the map
+     * @param found_path Vector the found path is written to, from the start to the end
+     * @return True if a path is found, false otherwise
+     */
+    template <typename States>
+    bool bidirectional(States &forward, States &backward, size_t item_cnt, Place start, Place end,
+                       std::vector<Place> &found_path) const
+    {
+        Mask trgt_mask = CMaskTraits<Mask>::full(item_cnt);
+
+        // One side of the search: its states, their masks and depths by place for the meeting test, its frontier
+        struct CSide
+        {
+            States &states;
+            std::unordered_map<uint32_t, std::vector<std::pair<Mask, uint32_t>>> reached;
+            std::vector<std::pair<uint32_t, Mask>> frontier;
+            uint32_t depth = 0;
+        };
+        CSide sides[2] = {{forward, {}, {}}, {backward, {}, {}}};
 
-                if (!predators.count({nbr, new_mask})) // If the neighbour hasn't been visited with this bitmask
+        uint32_t best = UNREACHABLE;
+        uint32_t meet_depth = 0; // Edges of the best path before the meeting place
+        std::pair<uint32_t, Mask> meet_forward{}, meet_backward{};
+        auto reach = [&](size_t side, uint32_t place, Mask mask, uint32_t from, Mask from_mask, uint32_t depth)
+        {
+            if (!sides[side].states.insert(place, mask, from, from_mask))
+                return;
+            PATH_COUNT(visited, 1);
+            sides[side].frontier.emplace_back(place, mask);
+            sides[side].reached[place].emplace_back(mask, depth);
+            auto other = sides[1 - side].reached.find(place);
+            if (other == sides[1 - side].reached.end())
+                return;
+            for (const auto &[other_mask, other_depth] : other->second)
+                if ((Mask)(mask | other_mask) == trgt_mask && depth + other_depth < best)
                 {
-                    predators.insert({{nbr, new_mask}, node}); // Mark it as visited
-                    if (new_mask == trgt_mask && nbr == end) // If all items are collected and we're at the end
+                    best = depth + other_depth;
+                    meet_depth = side ? other_depth : depth;
+                    meet_forward = {place, side ? other_mask : mask};
+                    meet_backward = {place, side ? mask : other_mask};
+                }
+        };
+        reach(0, (uint32_t)start, place_items[start], NO_PLACE, Mask(), 0);
+        reach(1, (uint32_t)end, place_items[end], NO_PLACE, Mask(), 0);
+
+        while (best > sides[0].depth + sides[1].depth && (!sides[0].frontier.empty() || !sides[1].frontier.empty()))
+        {
+            size_t side = sides[1].frontier.empty() ||
+                          (!sides[0].frontier.empty() && sides[0].frontier.size() <= sides[1].frontier.size()) ? 0 : 1;
+            std::vector<std::pair<uint32_t, Mask>> level;
+            level.swap(sides[side].frontier);
+            uint32_t depth = ++sides[side].depth;
+            PATH_COUNT(expanded, level.size());
+            for (const auto &[place, mask] : level)
+                for (size_t i = offsets[place]; i < offsets[place + 1]; i++)
+                    reach(side, targets[i], (Mask)(mask | place_items[targets[i]]), place, mask, depth);
+        }
+        if (best == UNREACHABLE)
+            return false;
+
+        // The forward half is written back from the meeting place, the backward half is already ordered towards the end
+        found_path.reserve(best + 1);
+        backtrack(forward, meet_forward.first, meet_forward.second, meet_depth, found_path);
+        for (auto state = backward.predecessor(meet_backward.first, meet_backward.second); state.first != NO_PLACE;
+             state = backward.predecessor(state.first, state.second))
+            found_path.push_back(state.first);
+        return true;
+    }
+
+    /**
+     * Function to find a shortest path between two places.
+     * @param from The first place
+     * @param to The last place
+     * @param path Vector the places of the path are appended to, from the first one to the last one
+     * @return True if the places are connected
+     */
+    bool shortestPath(Place from, Place to, std::vector<Place> &path) const
+    {
+        PATH_COUNT(place_searches, 1);
+        std::vector<uint32_t> parent(places(), UNREACHABLE);
+        std::vector<uint32_t> q{(uint32_t)to}; // Searched from the last place, so the parents lead towards it
+        parent[to] = (uint32_t)to;
+        for (size_t head = 0; head < q.size() && parent[from] == UNREACHABLE; head++)
+            for (size_t i = offsets[q[head]]; i < offsets[q[head] + 1]; i++)
+                if (parent[targets[i]] == UNREACHABLE)
+                {
+                    parent[targets[i]] = q[head];
+                    q.push_back(targets[i]);
+                }
+        if (parent[from] == UNREACHABLE)
+            return false;
+        for (Place place = from; place != to; place = parent[place])
+            path.push_back(place);
+        path.push_back(to);
+        return true;
+    }
+
+    /**
+     * Function to get the distances between the places holding items, which Held-Karp needs for every query.
+     * @return The places holding items and the distances from each of them to all places
+     */
+    CItemDistances itemDistances() const
+    {
+        CItemDistances result;
+        for (size_t place = 0; place < places(); place++)
+            if (place_items[place] != Mask())
+                result.stops.push_back((uint32_t)place);
+        for (const auto &stop : result.stops)
+            result.between.push_back(distances(stop));
+        return result;
+    }
+
+    /**
+     * Function to find the shortest path that collects all items by a Held-Karp dynamic programming over the
+     * places holding items instead of over all (place, mask) states. The distances between those places come from
+     * one BFS per place, then the shortest tour from the start through places holding new items is extended group
+     * by group, and the path is the concatenation of the shortest paths between the stops of the best tour. The
+     * cost is O(L * (places + connections) + 2^items * L^2) for L places holding items.
+     * @param item_distances The places holding items and the distances from them, from itemDistances
+     * @param item_cnt The total number of items
+     * @param start The starting place in the map
+     * @param end The target place in the map
+     * @param found_path Vector the found path is written to, from the start to the end
+     * @return True if a path is found, false otherwise
+     */
+    bool itemTour(const CItemDistances &item_distances, size_t item_cnt, Place start, Place end,
+                  std::vector<Place> &found_path) const
+    {
+        const std::vector<uint32_t> &stops = item_distances.stops;
+        const std::vector<std::vector<uint32_t>> &between = item_distances.between;
+        Mask trgt_mask = CMaskTraits<Mask>::full(item_cnt);
+        std::vector<uint32_t> from_start = distances(start);
+
+        // Shortest tour ending at a stop with some items collected, and the stop and mask it came from
+        struct CTour
+        {
+            uint32_t length = UNREACHABLE;
+            uint32_t from = NO_PLACE; // Index of the previous stop, NO_PLACE for the start
+            Mask from_mask = Mask();
+        };
+        std::vector<std::unordered_map<Mask, std::vector<CTour>>> levels(item_cnt + 1); // By collected groups
+        auto relax = [&](Mask mask, uint32_t stop, uint32_t length, uint32_t from, Mask from_mask)
+        {
+            auto &tours = levels[CMaskTraits<Mask>::count(mask)][mask];
+            if (tours.empty())
+                tours.resize(stops.size());
+            if (tours[stop].length == UNREACHABLE)
+                PATH_COUNT(visited, 1);
+            if (length < tours[stop].length)
+                tours[stop] = {length, from, from_mask};
+        };
+
+        Mask strt_mask = place_items[start];
+        uint32_t best = strt_mask == trgt_mask ? from_start[end] : UNREACHABLE;
+        std::pair<Mask, uint32_t> last{strt_mask, NO_PLACE}; // End of the best tour before it goes to the end
+        for (uint32_t j = 0; j < stops.size(); j++)
+        {
+            Mask mask = (Mask)(strt_mask | place_items[stops[j]]);
+            if (mask != strt_mask && from_start[stops[j]] != UNREACHABLE)
+                relax(mask, j, from_start[stops[j]], NO_PLACE, strt_mask);
+        }
+        for (size_t level = CMaskTraits<Mask>::count(strt_mask) + 1; level <= item_cnt; level++)
+            for (const auto &[mask, tours] : levels[level])
+                for (uint32_t i = 0; i < stops.size(); i++)
+                {
+                    if (tours[i].length == UNREACHABLE)
+                        continue;
+                    PATH_COUNT(expanded, 1);
+                    if (mask == trgt_mask)
                     {
-                        Place dest = nbr;
-                        while ((int)dest != -1) // Backtrack to find the path
+                        if (between[i][end] != UNREACHABLE && tours[i].length + between[i][end] < best)
                         {
-                            found_path.push_back(dest);
-                            Place tmp_dest = dest;
-                            tmp_dest = predators[{dest, new_mask}].first;
-                            new_mask = predators[{dest, new_mask}].second;
-                            dest = tmp_dest;
+                            best = tours[i].length + between[i][end];
+                            last = {mask, i};
                         }
-                        return true;
+                        continue;
+                    }
+                    for (uint32_t j = 0; j < stops.size(); j++)
+                    {
+                        Mask next = (Mask)(mask | place_items[stops[j]]);
+                        if (next != mask && between[i][stops[j]] != UNREACHABLE)
+                            relax(next, j, tours[i].length + between[i][stops[j]], i, mask);
                     }
-                    else
-                        q.emplace(nbr, new_mask); // Continue exploring
                 }
+        if (best == UNREACHABLE)
+            return false;
+
+        // Walk the best tour back to the start, then join the shortest paths between its stops
+        std::vector<Place> tour{end};
+        for (auto [mask, stop] = last; stop != NO_PLACE;)
+        {
+            tour.push_back(stops[stop]);
+            const CTour &t = levels[CMaskTraits<Mask>::count(mask)].at(mask)[stop];
+            stop = t.from;
+            mask = t.from_mask;
+        }
+        tour.push_back(start);
+        std::reverse(tour.begin(), tour.end());
+        found_path.clear();
+        found_path.reserve(best + 1);
+        found_path.push_back(start);
+        for (size_t i = 0; i + 1 < tour.size(); i++)
+        {
+            found_path.pop_back(); // The first place of the segment ends the previous one
+            shortestPath(tour[i], tour[i + 1], found_path);
+        }
+        return true;
+    }
+
+    /**
+     * Function to perform a level-synchronous BFS over several threads to find the shortest path that collects
+     * all items. Expanding the edge of a queued state is an attempt, numbered in the order the sequential bfs makes
+     * them, and every state keeps the smallest attempt that reached it in an atomic word, so it ends up with the
+     * predecessor bfs would give it and the path is the same. Each thread expands a part of the frontier top-down
+     * and lists the attempts that lowered the attempt of a state, in order. Once the frontier has more edges than
+     * the unvisited states, the level is searched bottom-up instead: every unvisited state looks for predecessors in
+     * the frontier. The listed attempts that still hold their state are queued as the next frontier, in the order
+     * bfs would queue them. The states are indexed by place * 2^items + mask, as in CDenseStates, and take 8 bytes
+     * and 1 bit each.
+     * @param item_cnt The total number of items, places * 2^items must be below DENSE_STATE_LIMIT
+     * @param start The starting place in the map
+     * @param end The target place in the map
+     * @param found_path Vector the found path is written to, from the start to the end
+     * @param thread_cnt Most threads to use, the calling thread included
+     * @return True if a path is found, false otherwise
+     */
+    bool parallelBfs(size_t item_cnt, Place start, Place end, std::vector<Place> &found_path, size_t thread_cnt) const
+    {
+        size_t mask_cnt = size_t(1) << item_cnt;
+        size_t state_cnt = places() * mask_cnt;
+        std::vector<size_t> items(places()); // Masks of the items at the places, as state indices
+        for (size_t place = 0; place < places(); place++)
+            items[place] = CMaskTraits<Mask>::index(place_items[place]);
+        size_t strt_state = start * mask_cnt + items[start];
+        size_t trgt_state = end * mask_cnt + mask_cnt - 1;
+        if (strt_state == trgt_state)
+        {
+            found_path.assign(1, start);
+            return true;
+        }
+
+        // Attempt reaching each state plus one, 0 for unvisited states. The start has attempt 0, the attempts from
+        // the state at position k of the queue are first[k] up to first[k + 1].
+        std::vector<std::atomic<uint64_t>> reached(state_cnt);
+        reached[strt_state].store(1, std::memory_order_relaxed);
+        // One bit per state of the finished levels, only written between levels, so most edges are dropped without
+        // touching the far larger attempts
+        std::vector<uint64_t> done((state_cnt + 63) / 64);
+        done[strt_state / 64] |= uint64_t(1) << (strt_state % 64);
+        std::vector<size_t> queue{strt_state}; // Every visited state in the order bfs would queue it
+        PATH_COUNT(visited, 1);
+        std::vector<uint64_t> first{1};
+        size_t average_degree = targets.size() / std::max<size_t>(1, places()) + 1;
+        // Attempts that lowered the attempt of a state, with the state, in the order of the attempts in each part
+        std::vector<std::vector<std::pair<uint64_t, size_t>>> won(thread_cnt);
+        std::vector<std::pair<uint64_t, size_t>> next;
+        size_t depth = 0; // Levels expanded so far
+
+        for (size_t head = 0; head < queue.size() && reached[trgt_state].load(std::memory_order_relaxed) == 0;)
+        {
+            size_t level_end = queue.size();
+            for (size_t k = head; k < level_end; k++)
+                first.push_back(first.back() + offsets[queue[k] / mask_cnt + 1] - offsets[queue[k] / mask_cnt]);
+            for (auto &part : won)
+                part.clear();
+
+            size_t parts;
+            bool bottom_up =
+                    (first.back() - first[head]) * BOTTOM_UP_FACTOR > (state_cnt - queue.size()) * average_degree;
+            if (!bottom_up)
+            {
+                parts = parallel_for(level_end - head, thread_cnt, [&](size_t part, size_t from, size_t to)
+                {
+                    bool alone = to - from == level_end - head;
+                    for (size_t k = head + from; k < head + to; k++)
+                    {
+                        size_t place = queue[k] / mask_cnt, mask = queue[k] % mask_cnt;
+                        for (size_t i = offsets[place]; i < offsets[place + 1]; i++)
+                        {
+                            size_t state = targets[i] * mask_cnt + (mask | items[targets[i]]);
+                            if ((done[state / 64] >> (state % 64)) & 1)
+                                continue;
+                            uint64_t attempt = first[k] + (i - offsets[place]) + 1;
+                            uint64_t current = reached[state].load(std::memory_order_relaxed);
+                            if (alone && (current == 0 || current > attempt))
+                            {
+                                // No other part, a plain store does not stall the loads like a locked exchange
+                                reached[state].store(attempt, std::memory_order_relaxed);
+                                won[part].emplace_back(attempt, state);
+                                continue;
+                            }
+                            while (current == 0 || current > attempt)
+                                if (reached[state].compare_exchange_weak(current, attempt, std::memory_order_relaxed))
+                                {
+                                    won[part].emplace_back(attempt, state);
+                                    break;
+                                }
+                        }
+                    }
+                });
+            }
+            else
+            {
+                // Only the frontier states have attempts in this range, found by binary search over the frontier
+                uint64_t lowest = reached[queue[head]].load(std::memory_order_relaxed);
+                uint64_t highest = reached[queue[level_end - 1]].load(std::memory_order_relaxed);
+                auto before = [&](size_t s, uint64_t key) { return reached[s].load(std::memory_order_relaxed) < key; };
+                parts = parallel_for(state_cnt, thread_cnt, [&](size_t part, size_t from, size_t to)
+                {
+                    for (size_t state = from; state < to; state++)
+                    {
+                        size_t place = state / mask_cnt, mask = state % mask_cnt;
+                        if ((mask & items[place]) != items[place] || ((done[state / 64] >> (state % 64)) & 1))
+                            continue;
+                        uint64_t best = 0;
+                        for (size_t i = offsets[place]; i < offsets[place + 1]; i++)
+                        {
+                            size_t nbr = targets[i];
+                            // Predecessor masks hold the mask without the items of this place and any of those items
+                            size_t picked = mask & items[place];
+                            for (size_t sub = picked;; sub = (sub - 1) & picked)
+                            {
+                                uint64_t pred = reached[nbr * mask_cnt + (mask & ~items[place]) + sub].load(
+                                        std::memory_order_relaxed);
+                                if (pred >= lowest && pred <= highest)
+                                {
+                                    size_t k = std::lower_bound(queue.begin() + head, queue.begin() + level_end, pred,
+                                                                before) - queue.begin();
+                                    auto adjacent = targets.begin() + offsets[nbr];
+                                    size_t slot = std::find(adjacent, targets.begin() + offsets[nbr + 1], place) -
+                                                  adjacent;
+                                    if (best == 0 || first[k] + slot + 1 < best)
+                                        best = first[k] + slot + 1;
+                                }
+                                if (sub == 0)
+                                    break;
+                            }
+                        }
+                        if (best != 0)
+                        {
+                            reached[state].store(best, std::memory_order_relaxed);
+                            won[part].emplace_back(best, state);
+                        }
+                    }
+                });
             }
+
+            // The attempts are final only once all parts are done, a state belongs to the attempt that still holds it.
+            // The top-down parts made their attempts in order, one after the other, the bottom-up ones did not.
+            next.clear();
+            for (size_t part = 0; part < parts; part++)
+                for (const auto &[attempt, state] : won[part])
+                    if (reached[state].load(std::memory_order_relaxed) == attempt)
+                        next.emplace_back(attempt, state);
+            if (bottom_up)
+                std::sort(next.begin(), next.end());
+            for (const auto &[attempt, state] : next)
+            {
+                queue.push_back(state);
+                done[state / 64] |= uint64_t(1) << (state % 64);
+            }
+            PATH_COUNT(expanded, level_end - head);
+            PATH_COUNT(visited, next.size());
+            head = level_end;
+            depth++;
         }
-        return false; // Return false if no path found
+        if (reached[trgt_state].load(std::memory_order_relaxed) == 0)
+            return false;
+
+        // The predecessor made the attempt, it is the last queued state whose attempts start at or before it
+        found_path.resize(depth + 1);
+        size_t state = trgt_state;
+        for (size_t i = depth; i > 0; i--)
+        {
+            found_path[i] = state / mask_cnt;
+            uint64_t attempt = reached[state].load(std::memory_order_relaxed) - 1;
+            state = queue[std::upper_bound(first.begin(), first.end(), attempt) - first.begin() - 1];
+        }
+        found_path[0] = start;
+        return true;
     }
 };
 
 /**
- * Function to find the path from start to end in the map while collecting all items.
+ * Function to run the search of the given mode with the given storage of states.
+ * @param g The graph of the map
+ * @param items The places of the item groups
+ * @param mode The search strategy
+ * @param start The starting place in the map
+ * @param end The target place in the map
+ * @param found_path Vector the found path is written to, from the start to the end
+ * @param args Arguments of the constructor of the storage
+ * @return True if a path is found, false otherwise
+ */
+template <typename States, typename Mask, typename... Args>
+bool search(const Graph<Mask> &g, const std::vector<std::vector<Place>> &items, SearchMode mode, Place start,
+            Place end, std::vector<Place> &found_path, const Args &...args)
+{
+    States states(args...);
+    if (mode == SearchMode::DIJKSTRA)
+        return g.dijkstra(states, items.size(), start, end, found_path);
+    if (mode == SearchMode::A_STAR)
+        return g.astar(states, items, start, end, found_path);
+    if (mode == SearchMode::BIDIRECTIONAL)
+    {
+        States backward(args...);
+        return g.bidirectional(states, backward, items.size(), start, end, found_path);
+    }
+    return g.bfs(states, items.size(), start, end, found_path);
+}
+
+/**
+ * Function to choose the search strategy for a map. Maps whose states fit into the flat arrays are searched by BFS,
+ * larger ones by Held-Karp if its estimated work over the places holding items is smaller than the number of states.
  * @param map The map containing places, connections, and items
- * @return A list of places representing the found path, or an empty list if no path is found
+ * @return The search strategy
  */
-std::list<Place> find_path(const Map &map)
+template <typename AnyMap>
+SearchMode choose_mode(const AnyMap &map)
+{
+    double masks = std::pow(2.0, (double)map.items.size());
+    double states = (double)map.places * masks;
+    if (states <= (double)DENSE_STATE_LIMIT)
+        return SearchMode::BFS;
+    std::unordered_set<Place> stops;
+    for (const auto &group : map.items)
+        stops.insert(group.begin(), group.end());
+    double l = (double)stops.size();
+    double tour = l * (double)(map.places + 2 * map.connections.size()) + masks * l * l;
+    return tour < states ? SearchMode::HELD_KARP : SearchMode::BFS;
+}
+
+// Graph of a map with masks of a given type, its search strategy and the distances Held-Karp needs, built once and
+// then only read by the queries
+template <typename Mask>
+class CPreparedGraph
+{
+public:
+    /**
+     * Constructor building the graph of a map.
+     * @param map The map containing places, connections, and items
+     * @param mode The search strategy of all queries
+     */
+    template <typename AnyMap>
+    CPreparedGraph(const AnyMap &map, SearchMode mode) : g(map), items(map.items), mode(mode)
+    {
+        if (mode == SearchMode::HELD_KARP)
+            item_distances = g.itemDistances();
+    }
+
+    /**
+     * Function to find the path between two places of the map while collecting all items.
+     * The states are kept in flat arrays unless places * 2^items exceeds DENSE_STATE_LIMIT. The parallel search
+     * needs the flat arrays and more than one hardware thread, otherwise bfs finds the same path.
+     * @param start The starting place
+     * @param end The target place
+     * @param found_path Vector the found path is written to, from the start to the end, emptied if there is none
+     * @return True if a path is found, false otherwise
+     */
+    bool find_path(Place start, Place end, std::vector<Place> &found_path) const
+    {
+        found_path.clear();
+        if (start >= g.places() || end >= g.places())
+            return false; // Not a place of the map
+        size_t item_cnt = items.size();
+
+        bool found;
+        if (mode == SearchMode::HELD_KARP)
+            found = g.itemTour(item_distances, item_cnt, start, end, found_path);
+        else if (item_cnt < 32 && g.places() < NO_PLACE && g.places() <= (DENSE_STATE_LIMIT >> item_cnt) &&
+                 mode == SearchMode::PARALLEL_BFS && std::thread::hardware_concurrency() > 1)
+            found = g.parallelBfs(item_cnt, start, end, found_path, std::thread::hardware_concurrency());
+        else if (item_cnt < 32 && g.places() < NO_PLACE && g.places() <= (DENSE_STATE_LIMIT >> item_cnt))
+            found = search<CDenseStates<Mask>>(g, items, mode, start, end, found_path, g.places(), item_cnt);
+        else
+            found = search<CHashedStates<Mask>>(g, items, mode, start, end, found_path);
+        if (!found)
+            found_path.clear(); // The searches may leave a part of a path behind
+        return found;
+    }
+
+private:
+    Graph<Mask> g; // Adjacency and item masks of the places
+    std::vector<std::vector<Place>> items; // The places of the item groups
+    SearchMode mode; // Search strategy of all queries
+    CItemDistances item_distances; // Distances between the places holding items, for Held-Karp only
+};
+
+// Map prepared for many queries between different places. The masks are the narrowest unsigned integers holding
+// all item groups, or a std::bitset above 64 groups. A prepared map is not changed by queries, so any number of
+// threads may query it at once.
+class PreparedMap
 {
-    Graph g;
-    size_t item_cnt = 0;
+public:
+    /**
+     * Constructor preparing a map with the search strategy chosen by choose_mode.
+     * @param map The map containing places, connections, and items, its start and end are not used
+     */
+    explicit PreparedMap(const Map &map) : PreparedMap(map, choose_mode(map))
+    {
+    }
+
+    /**
+     * Constructor preparing a map with a given search strategy.
+     * @param map The map containing places, connections, and items, its start and end are not used
+     * @param mode The search strategy of all queries
+     */
+    PreparedMap(const Map &map, SearchMode mode) : graph(prepare(map, mode))
+    {
+    }
+
+    /**
+     * Constructor preparing a map whose connections have lengths. Dijkstra's algorithm finds the shortest paths,
+     * unless all connections have the same length and the strategy of the map without lengths finds them faster.
+     * @param map The map containing places, connections with lengths, and items, its start and end are not used
+     */
+    explicit PreparedMap(const WeightedMap &map) : graph(prepare(map, choose_weighted_mode(map)))
+    {
+    }
 
-    // Map each item to its location
-    for (const auto &row : map.items)
+    /**
+     * Function to find the path between two places of the map while collecting all items into a vector, which is
+     * only allocated if its capacity is too small.
+     * @param start The starting place
+     * @param end The target place
+     * @param found_path Vector the found path is written to, from the start to the end, emptied if there is none
+     * @return True if a path is found, false otherwise
+     */
+    bool find_path(Place start, Place end, std::vector<Place> &found_path) const
+    {
+        return std::visit([&](const auto &prepared) { return prepared.find_path(start, end, found_path); }, graph);
+    }
+
+    /**
+     * Function to find the path between two places of the map while collecting all items.
+     * @param start The starting place
+     * @param end The target place
+     * @return A list of places representing the found path, or an empty list if no path is found
+     */
+    std::list<Place> find_path(Place start, Place end) const
+    {
+        std::vector<Place> found_path;
+        find_path(start, end, found_path);
+        return {found_path.begin(), found_path.end()};
+    }
+
+private:
+    using CVariant = std::variant<CPreparedGraph<uint16_t>, CPreparedGraph<uint32_t>, CPreparedGraph<uint64_t>,
+                                  CPreparedGraph<std::bitset<MAX_ITEM_GROUPS>>>;
+
+    CVariant graph; // The graph with the narrowest masks
+
+    /**
+     * Function to choose the search strategy for a map whose connections have lengths.
+     * @param map The map containing places, connections with lengths, and items
+     * @return The strategy of choose_mode if all connections have the same length, DIJKSTRA otherwise
+     */
+    static SearchMode choose_weighted_mode(const WeightedMap &map)
+    {
+        for (const auto &connection : map.connections)
+            if (std::get<2>(connection) != std::get<2>(map.connections.front()) || std::get<2>(connection) == 0)
+                return SearchMode::DIJKSTRA;
+        return choose_mode(map);
+    }
+
+    /**
+     * Function to build the graph with the narrowest masks holding all item groups of a map.
+     * @param map The map containing places, connections, and items
+     * @param mode The search strategy of all queries
+     * @return The prepared graph
+     */
+    template <typename AnyMap>
+    static CVariant prepare(const AnyMap &map, SearchMode mode)
+    {
+        size_t item_cnt = map.items.size();
+        if (item_cnt <= 16)
+            return CPreparedGraph<uint16_t>(map, mode);
+        if (item_cnt <= 32)
+            return CPreparedGraph<uint32_t>(map, mode);
+        if (item_cnt <= 64)
+            return CPreparedGraph<uint64_t>(map, mode);
+        if (item_cnt <= MAX_ITEM_GROUPS)
+            return CPreparedGraph<std::bitset<MAX_ITEM_GROUPS>>(map, mode);
+        throw std::length_error("too many item groups");
+    }
+};
+
+// Threads kept alive between batches of queries, so that many small batches do not pay for starting and joining
+// threads every time. The calling thread answers queries as well, so the pool starts one thread less than
+// thread_cnt. Batches on one pool run one after another.
+class QueryPool
+{
+public:
+    /**
+     * Constructor starting the worker threads, which sleep until a batch arrives.
+     * @param thread_cnt Number of threads answering a batch, the calling thread included
+     */
+    explicit QueryPool(size_t thread_cnt = std::max(1u, std::thread::hardware_concurrency()))
+    {
+        for (size_t i = 1; i < thread_cnt; i++)
+            workers.emplace_back([this]() { serve(); });
+    }
+
+    QueryPool(const QueryPool &) = delete;
+    QueryPool &operator=(const QueryPool &) = delete;
+
+    /**
+     * Destructor waking the worker threads to let them finish and joining them.
+     */
+    ~QueryPool()
     {
-        for (const auto &col : row)
         {
-            g.item_location[col].push_back(item_cnt);
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
         }
-        item_cnt++;
+        wake.notify_all();
+        for (auto &worker : workers)
+            worker.join();
     }
 
-    // Map each item to a unique bitmask
-    uint16_t mask = 1;
-    for (size_t i = 0; i < map.items.size(); i++)
+    /**
+     * Function to find the paths of many queries on one prepared map. The queries are handed out one at a time, so
+     * a few long searches do not hold up the rest.
+     * @param prepared The prepared map
+     * @param queries The (start, end) pairs
+     * @param paths Vectors the path of every query is written to in the order of the queries, empty if there is no
+     * path. Vectors kept from an earlier batch are reused.
+     */
+    void find_paths(const PreparedMap &prepared, const std::vector<std::pair<Place, Place>> &queries,
+                    std::vector<std::vector<Place>> &paths)
     {
-        g.item_bitmask[i] = mask;
-        mask <<= 1;
+        std::lock_guard<std::mutex> batch_lock(batch_mutex);
+        paths.resize(queries.size());
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            batch = {&prepared, &queries, &paths};
+            next = 0;
+            running = workers.size();
+            generation++;
+        }
+        wake.notify_all();
+        answer(); // The calling thread answers queries itself
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [this]() { return running == 0; });
     }
 
-    // Map each place to its neighbours
-    for (const auto &connection : map.connections)
+private:
+    // The batch being answered
+    struct CBatch
+    {
+        const PreparedMap *prepared;
+        const std::vector<std::pair<Place, Place>> *queries;
+        std::vector<std::vector<Place>> *paths;
+    };
+
+    std::vector<std::thread> workers; // The threads besides the calling one
+    std::mutex batch_mutex; // Held for a whole batch, so batches from several threads take turns
+    std::mutex mutex; // Guards the fields below
+    std::condition_variable wake; // Signals a new batch or the end of the pool
+    std::condition_variable finished; // Signals that the last worker is done with a batch
+    CBatch batch{nullptr, nullptr, nullptr};
+    std::atomic<size_t> next{0}; // Index of the next query to answer
+    size_t running = 0; // Workers still answering the current batch
+    size_t generation = 0; // Number of batches started
+    bool stopping = false; // Whether the pool is being destroyed
+
+    /**
+     * Function to take queries of the current batch one at a time until none is left.
+     */
+    void answer()
     {
-        g.map_neighbours[connection.first].push_back(connection.second);
-        g.map_neighbours[connection.second].push_back(connection.first);
+        const auto &queries = *batch.queries;
+        for (size_t i = next++; i < queries.size(); i = next++)
+            batch.prepared->find_path(queries[i].first, queries[i].second, (*batch.paths)[i]);
     }
 
-    std::list<Place> found_path;
-    if (g.bfs(map.items.size(), map.start, map.end, found_path))
+    /**
+     * Function run by every worker thread: wait for a batch, help answering it and report when done.
+     */
+    void serve()
     {
-        found_path.reverse(); // Reverse the path to get the correct order
-        return found_path;
+        size_t seen = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            wake.wait(lock, [&]() { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+            lock.unlock();
+            answer();
+            lock.lock();
+            if (--running == 0)
+                finished.notify_one();
+        }
     }
+};
+
+/**
+ * Function to find the paths of many queries on one prepared map with a pool started for this batch alone. Code
+ * answering many batches should keep one QueryPool instead, which starts its threads only once.
+ * @param prepared The prepared map
+ * @param queries The (start, end) pairs
+ * @param paths Vectors the path of every query is written to in the order of the queries, empty if there is no
+ * path. Vectors kept from an earlier batch are reused.
+ * @param thread_cnt Number of threads, the calling thread included
+ */
+void find_paths(const PreparedMap &prepared, const std::vector<std::pair<Place, Place>> &queries,
+                std::vector<std::vector<Place>> &paths,
+                size_t thread_cnt = std::max(1u, std::thread::hardware_concurrency()))
+{
+    QueryPool(std::min(thread_cnt, std::max<size_t>(1, queries.size()))).find_paths(prepared, queries, paths);
+}
+
+/**
+ * Function to find the paths of many queries on one prepared map.
+ * @param prepared The prepared map
+ * @param queries The (start, end) pairs
+ * @param thread_cnt Number of threads, the calling thread included
+ * @return The path of every query in the order of the queries, empty if there is no path
+ */
+std::vector<std::list<Place>> find_paths(const PreparedMap &prepared, const std::vector<std::pair<Place, Place>> &queries,
+                                         size_t thread_cnt = std::max(1u, std::thread::hardware_concurrency()))
+{
+    std::vector<std::vector<Place>> found_paths;
+    find_paths(prepared, queries, found_paths, thread_cnt);
+    std::vector<std::list<Place>> paths;
+    for (const auto &path : found_paths)
+        paths.emplace_back(path.begin(), path.end());
+    return paths;
+}
+
+/**
+ * Function to find the path from start to end in the map while collecting all items.
+ * @param map The map containing places, connections, and items
+ * @param mode The search strategy
+ * @return A list of places representing the found path, or an empty list if no path is found
+ */
+std::list<Place> find_path(const Map &map, SearchMode mode)
+{
+    return PreparedMap(map, mode).find_path(map.start, map.end);
+}
+
+/**
+ * Function to find the path from start to end in the map while collecting all items into a vector.
+ * @param map The map containing places, connections, and items
+ * @param mode The search strategy
+ * @param found_path Vector the found path is written to, from the start to the end, emptied if there is none
+ * @return True if a path is found, false otherwise
+ */
+bool find_path(const Map &map, SearchMode mode, std::vector<Place> &found_path)
+{
+    return PreparedMap(map, mode).find_path(map.start, map.end, found_path);
+}
+
+/**
+ * Function to find the path from start to end in the map while collecting all items into a vector.
+ * @param map The map containing places, connections, and items
+ * @param found_path Vector the found path is written to, from the start to the end, emptied if there is none
+ * @return True if a path is found, false otherwise
+ */
+bool find_path(const Map &map, std::vector<Place> &found_path)
+{
+    return find_path(map, choose_mode(map), found_path);
+}
+
+/**
+ * Function to find the path from start to end in the map while collecting all items.
+ * @param map The map containing places, connections, and items
+ * @return A list of places representing the found path, or an empty list if no path is found
+ */
+std::list<Place> find_path(const Map &map)
+{
+    return find_path(map, choose_mode(map));
+}
+
+/**
+ * Function to find the shortest path by the lengths of the connections from start to end in the map while
+ * collecting all items.
+ * @param map The map containing places, connections with lengths, and items
+ * @param found_path Vector the found path is written to, from the start to the end, emptied if there is none
+ * @return True if a path is found, false otherwise
+ */
+bool find_path(const WeightedMap &map, std::vector<Place> &found_path)
+{
+    return PreparedMap(map).find_path(map.start, map.end, found_path);
+}
+
+/**
+ * Function to find the shortest path by the lengths of the connections from start to end in the map while
+ * collecting all items.
+ * @param map The map containing places, connections with lengths, and items
+ * @return A list of places representing the found path, or an empty list if no path is found
+ */
+std::list<Place> find_path(const WeightedMap &map)
+{
+    return PreparedMap(map).find_path(map.start, map.end);
+}
 
-    return {}; // Return an empty list if no path is found
+/**
+ * Function to get the length of a path in a map whose connections have lengths, taking the shortest connection
+ * between every two consecutive places.
+ * @param map The map containing places, connections with lengths, and items
+ * @param path The places of the path
+ * @return The total length, or std::nullopt if two consecutive places are not connected
+ */
+std::optional<uint64_t> path_length(const WeightedMap &map, const std::vector<Place> &path)
+{
+    std::unordered_map<std::pair<Place, Place>, uint32_t> shortest;
+    for (const auto &[a, b, length] : map.connections)
+        for (const auto &key : {std::pair<Place, Place>{a, b}, std::pair<Place, Place>{b, a}})
+        {
+            auto it = shortest.emplace(key, length).first;
+            it->second = std::min(it->second, length);
+        }
+    uint64_t total = 0;
+    for (size_t i = 0; i + 1 < path.size(); i++)
+    {
+        auto it = shortest.find({path[i], path[i + 1]});
+        if (it == shortest.end())
+            return std::nullopt;
+        total += it->second;
+    }
+    return total;
 }
 
 #ifndef __PROGTEST__
@@ -187,8 +1489,26 @@ const std::array examples = {
         TestCase{3, Map{4, 0, 1, {{0, 2}, {2, 3}, {0, 3}, {3, 1}}, {}}}, // Test case 2
         TestCase{4, Map{4, 0, 1, {{0, 2}, {2, 3}, {0, 3}, {3, 1}}, {{2}}}}, // Test case 3
         TestCase{0, Map{4, 0, 1, {{0, 2}, {2, 3}, {0, 3}, {3, 1}}, {{2}, {}}}}, // Test case 4
+        TestCase{1, Map{3, 2, 2, {{0, 1}, {1, 2}}, {}}}, // Test case 5
+        TestCase{0, Map{4, 0, 3, {{0, 1}, {2, 3}}, {}}}, // Test case 6
+        TestCase{6, Map{6, 0, 5, {{0, 1}, {1, 2}, {2, 3}, {3, 4}, {4, 5}, {1, 3}}, {{2, 4}, {0}, {2}}}}, // Test case 7
 };
 
+/**
+ * Function to find a path with the states kept in a hash map, to check the flat arrays against it.
+ * @param map The map containing places, connections, and items
+ * @return A list of places representing the found path, or an empty list if no path is found
+ */
+std::list<Place> find_path_hashed(const Map &map)
+{
+    Graph<> g(map);
+    CHashedStates<> states;
+    std::vector<Place> found_path;
+    if (!g.bfs(states, map.items.size(), map.start, map.end, found_path))
+        return {};
+    return {found_path.begin(), found_path.end()};
+}
+
 /**
  * Main function to run the test cases and verify the correctness of the find_path function.
  * @return 0 if all tests pass, otherwise returns the number of failed tests
@@ -201,13 +1521,159 @@ int main()
     for (size_t i = 0; i < examples.size(); i++)
     {
         auto sol = find_path(examples[i].second); // Get the path for the current test case
-        if (sol.size() != examples[i].first) // Check if the path length matches the expected result
+        auto hashed = find_path_hashed(examples[i].second); // The same search with hashed states
+        auto bidirectional = find_path(examples[i].second, SearchMode::BIDIRECTIONAL);
+        auto astar = find_path(examples[i].second, SearchMode::A_STAR);
+        auto tour = find_path(examples[i].second, SearchMode::HELD_KARP);
+        if (sol.size() != examples[i].first || sol != hashed || bidirectional.size() != sol.size() ||
+            astar.size() != sol.size() || tour.size() != sol.size()) // Check if the path length matches
         {
             std::cout << "Wrong answer for map " << i << std::endl; // Output error message if it doesn't match
             fail++;
         }
     }
 
+    // The vector output gives the same paths as the lists, into one reused buffer that starts out dirty
+    std::vector<Place> buffer{42, 42, 42};
+    for (size_t i = 0; i < examples.size(); i++)
+        for (SearchMode mode : {SearchMode::BFS, SearchMode::BIDIRECTIONAL, SearchMode::A_STAR, SearchMode::HELD_KARP,
+                                SearchMode::PARALLEL_BFS})
+        {
+            auto sol = find_path(examples[i].second, mode);
+            bool found = find_path(examples[i].second, mode, buffer);
+            if (found == sol.empty() || !std::equal(buffer.begin(), buffer.end(), sol.begin(), sol.end()))
+            {
+                std::cout << "Wrong vector answer for map " << i << std::endl;
+                fail++;
+            }
+        }
+
+    // Connections with lengths: the item is fetched over the short detour, of two parallel connections the shorter
+    // one counts, and with one length for all connections the paths of the examples are found again
+    {
+        WeightedMap detour{5, 0, 1, {{0, 1, 10}, {0, 2, 1}, {2, 3, 1}, {3, 1, 1}, {1, 4, 2}, {0, 4, 20}}, {{4}}};
+        WeightedMap parallel{2, 0, 1, {{0, 1, 5}, {0, 1, 2}}, {}};
+        std::vector<Place> path;
+        bool right = find_path(detour, path) && path == std::vector<Place>{0, 2, 3, 1, 4, 1} &&
+                     path_length(detour, path) == 7u && find_path(parallel, path) && path_length(parallel, path) == 2u;
+        for (size_t i = 0; i < examples.size(); i++)
+        {
+            const Map &map = examples[i].second;
+            WeightedMap uniform{map.places, map.start, map.end, {}, map.items};
+            for (const auto &[a, b] : map.connections)
+                uniform.connections.emplace_back(a, b, 3);
+            WeightedMap mixed = uniform;
+            if (!mixed.connections.empty())
+                std::get<2>(mixed.connections.front()) = 1; // Searched by Dijkstra's algorithm instead of BFS
+            find_path(uniform, path);
+            right = right && path.size() == examples[i].first &&
+                    find_path(map, SearchMode::DIJKSTRA).size() == examples[i].first &&
+                    (path.empty() || path_length(uniform, path) == 3 * (path.size() - 1));
+            // A shorter connection can only make the shortest path shorter
+            std::optional<uint64_t> before = path.empty() ? std::nullopt : path_length(uniform, path);
+            find_path(mixed, path);
+            right = right && path.empty() == !before && (path.empty() || *path_length(mixed, path) <= *before);
+        }
+        if (!right)
+        {
+            std::cout << "Wrong answer for connections with lengths" << std::endl;
+            fail++;
+        }
+    }
+
+    // Maps with more item groups than fit into 16 and 64 bits, held by the rooms of a corridor
+    for (auto [groups, rooms] : {std::pair<size_t, size_t>{20, 5}, {100, 10}})
+    {
+        Map map{2 * rooms + 1, 0, rooms, {}, std::vector<std::vector<Place>>(groups)};
+        for (size_t i = 0; i < rooms; i++)
+        {
+            map.connections.emplace_back(i, i + 1);
+            map.connections.emplace_back(i + 1, rooms + 1 + i);
+        }
+        for (size_t g = 0; g < groups; g++)
+            map.items[g].push_back(rooms + 1 + g % rooms);
+        size_t expected = 3 * rooms + 1; // Every room is entered and left
+        if (find_path(map, SearchMode::BFS).size() != expected || find_path(map).size() != expected ||
+            find_path(map, SearchMode::HELD_KARP).size() != expected)
+        {
+            std::cout << "Wrong answer for " << groups << " item groups" << std::endl;
+            fail++;
+        }
+    }
+
+    // The parallel search must give exactly the path of the sequential one, on a grid large enough to be split
+    // into parts and to switch to bottom-up levels
+    {
+        const size_t width = 150;
+        Map grid{width * width, 0, width * width - 1, {}, {{width * 7 + 100}, {width * 120 + 3}, {width * 75 + 75}}};
+        for (Place p = 0; p < grid.places; p++)
+        {
+            if (p % width + 1 < width)
+                grid.connections.emplace_back(p, p + 1);
+            if (p + width < grid.places)
+                grid.connections.emplace_back(p, p + width);
+        }
+        Graph<> g(grid);
+        std::vector<Place> sequential, parallel;
+        CDenseStates<> states(g.places(), grid.items.size());
+        g.bfs(states, grid.items.size(), grid.start, grid.end, sequential);
+        g.parallelBfs(grid.items.size(), grid.start, grid.end, parallel, 4);
+        bool same = sequential == parallel;
+        for (size_t i = 0; i < examples.size(); i++)
+            same = same && find_path(examples[i].second, SearchMode::PARALLEL_BFS) == find_path(examples[i].second);
+        if (!same)
+        {
+            std::cout << "Wrong answer of the parallel search" << std::endl;
+            fail++;
+        }
+    }
+
+    // Every pair of places of every map answered in one batch and one at a time
+    for (size_t i = 0; i < examples.size(); i++)
+    {
+        const Map &map = examples[i].second;
+        PreparedMap prepared(map);
+        std::vector<std::pair<Place, Place>> queries;
+        for (Place start = 0; start < map.places; start++)
+            for (Place end = 0; end < map.places; end++)
+                queries.emplace_back(start, end);
+        auto paths = find_paths(prepared, queries, 4);
+        for (size_t q = 0; q < queries.size(); q++)
+        {
+            Map single = map;
+            single.start = queries[q].first;
+            single.end = queries[q].second;
+            if (paths[q] != find_path(single))
+            {
+                std::cout << "Wrong batch answer for map " << i << std::endl;
+                fail++;
+                break;
+            }
+        }
+    }
+
+    // One pool answers the batches of all maps, twice, into the same vectors
+    QueryPool pool(4);
+    std::vector<std::vector<Place>> pooled;
+    for (int round = 0; round < 2; round++)
+        for (size_t i = 0; i < examples.size(); i++)
+        {
+            const Map &map = examples[i].second;
+            PreparedMap prepared(map);
+            std::vector<std::pair<Place, Place>> queries;
+            for (Place start = 0; start < map.places; start++)
+                for (Place end = 0; end < map.places; end++)
+                    queries.emplace_back(start, end);
+            pool.find_paths(prepared, queries, pooled);
+            std::vector<std::vector<Place>> expected;
+            find_paths(prepared, queries, expected, 1);
+            if (pooled != expected)
+            {
+                std::cout << "Wrong pooled batch answer for map " << i << std::endl;
+                fail++;
+            }
+        }
+
     if (fail)
         std::cout << "Failed " << fail << " tests" << std::endl; // Output number of failed tests
     else
@@ -0,0 +1,211 @@
+#include <cassert>
+#include <cstdint>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <limits>
+#include <optional>
+#include <algorithm>
+#include <bitset>
+#include <list>
+#include <array>
+#include <vector>
+#include <deque>
+#include <set>
+#include <map>
+#include <unordered_set>
+#include <unordered_map>
+#include <stack>
+#include <queue>
+#include <random>
+#include <string>
+#include <cstdlib>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+using ChristmasTree = size_t; // Alias for tree identifier
+
+// Structure representing the problem details for the tree problem
+struct TreeProblem {
+    int max_group_size; // Maximum group size allowed
+    std::vector<uint64_t> gifts; // Vector of gifts on each tree
+    std::vector<std::pair<ChristmasTree, ChristmasTree>> connections; // Pairs of connections between trees
+};
+
+// The solvers are compiled the same way as by the evaluator, without their tests and main
+#define __PROGTEST__
+namespace recursive {
+#include "recursive.cpp"
+}
+namespace iterative {
+#include "iterative.cpp"
+}
+namespace flat {
+#include "flat.cpp"
+}
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * Function to generate a tree where every tree is connected to a random earlier one, which keeps the depth logarithmic.
+ * @param tree_cnt Number of trees
+ * @param max_group_size The maximum size of the group allowed
+ * @param seed Seed of the random generator
+ * @return The generated problem
+ */
+TreeProblem generateRandom(size_t tree_cnt, int max_group_size, unsigned seed) {
+    std::mt19937 rng(seed);
+    TreeProblem problem{max_group_size, {}, {}};
+    problem.gifts.reserve(tree_cnt);
+    problem.connections.reserve(tree_cnt);
+    for (size_t i = 0; i < tree_cnt; i++) {
+        problem.gifts.push_back(rng() % 100);
+        if (i)
+            problem.connections.emplace_back(rng() % i, i);
+    }
+    return problem;
+}
+
+/**
+ * Function to generate a path of trees connected in a random order, the deepest possible tree.
+ * @param tree_cnt Number of trees
+ * @param max_group_size The maximum size of the group allowed
+ * @param seed Seed of the random generator
+ * @return The generated problem
+ */
+TreeProblem generatePath(size_t tree_cnt, int max_group_size, unsigned seed) {
+    std::mt19937 rng(seed);
+    TreeProblem problem{max_group_size, {}, {}};
+    std::vector<ChristmasTree> order(tree_cnt);
+    for (size_t i = 0; i < tree_cnt; i++) {
+        problem.gifts.push_back(rng() % 100);
+        order[i] = i;
+    }
+    std::shuffle(order.begin(), order.end(), rng);
+    for (size_t i = 1; i < tree_cnt; i++)
+        problem.connections.emplace_back(order[i - 1], order[i]);
+    return problem;
+}
+
+/**
+ * Function to measure one solver on a problem.
+ * @param solver The solve function of the solver
+ * @param problem The problem
+ * @param result Where to store the maximum presents
+ * @return Elapsed time in seconds
+ */
+double measure(uint64_t (*solver)(const TreeProblem &), const TreeProblem &problem, uint64_t &result) {
+    auto begin = Clock::now();
+    result = solver(problem);
+    return std::chrono::duration<double>(Clock::now() - begin).count();
+}
+
+/**
+ * Function to print the times of all solvers on one problem and check that their results agree.
+ * @param name Name of the problem shape
+ * @param problem The problem
+ * @param thread_cnt Number of threads of the parallel solver
+ */
+void benchmarkSolvers(const std::string &name, const TreeProblem &problem, size_t thread_cnt) {
+    uint64_t flat_result, iterative_result, recursive_result, parallel_result;
+    double flat_time = measure(flat::solve, problem, flat_result);
+    auto begin = Clock::now();
+    parallel_result = flat::solve_parallel(problem, thread_cnt);
+    double parallel_time = std::chrono::duration<double>(Clock::now() - begin).count();
+    double iterative_time = measure(iterative::solve, problem, iterative_result);
+    double recursive_time = measure(recursive::solve, problem, recursive_result);
+    std::cout << std::setw(8) << name << std::setw(10) << problem.gifts.size() << std::setw(6) << problem.max_group_size
+              << std::fixed << std::setprecision(4) << std::setw(12) << iterative_time << std::setw(12) << recursive_time
+              << std::setw(12) << flat_time << std::setw(12) << parallel_time << std::setw(10) << std::setprecision(1) << iterative_time / flat_time << "x"
+              << std::endl;
+    assert(iterative_result == flat_result);
+    assert(recursive_result == flat_result);
+    assert(parallel_result == flat_result);
+}
+
+/**
+ * Function to print the time of solve_groups for every group size on one problem.
+ * @param name Name of the problem shape
+ * @param problem The problem, its group size is overwritten
+ */
+void benchmarkGroups(const std::string &name, TreeProblem problem) {
+    for (int group = 1; group <= flat::MAX_GROUP_SIZE; group++) {
+        problem.max_group_size = group;
+        uint64_t result;
+        double time = measure(flat::solve_groups, problem, result);
+        std::cout << std::setw(8) << name << std::setw(10) << problem.gifts.size() << std::setw(6) << group
+                  << std::fixed << std::setprecision(4) << std::setw(12) << time << std::setw(14) << result << std::endl;
+    }
+}
+
+/**
+ * Function to print the average time of a point update of IncrementalSolver against solving the problem again.
+ * @param name Name of the problem shape
+ * @param problem The problem, its gifts are changed
+ * @param updates Number of updates
+ * @param seed Seed of the random generator
+ */
+void benchmarkIncremental(const std::string &name, TreeProblem problem, size_t updates, unsigned seed) {
+    std::mt19937 rng(seed);
+    auto begin = Clock::now();
+    flat::IncrementalSolver solver(problem);
+    double build_time = std::chrono::duration<double>(Clock::now() - begin).count();
+
+    std::vector<std::pair<ChristmasTree, uint64_t>> changes;
+    for (size_t i = 0; i < updates; i++)
+        changes.emplace_back(rng() % problem.gifts.size(), rng() % 100);
+    begin = Clock::now();
+    for (const auto &[tree, gift]: changes)
+        solver.update(tree, gift);
+    double update_time = std::chrono::duration<double>(Clock::now() - begin).count() / updates;
+
+    for (const auto &[tree, gift]: changes)
+        problem.gifts[tree] = gift;
+    uint64_t result;
+    double solve_time = measure(flat::solve, problem, result);
+    assert(result == solver.result());
+    std::cout << std::setw(8) << name << std::setw(10) << problem.gifts.size() << std::setw(6) << problem.max_group_size
+              << std::fixed << std::setprecision(4) << std::setw(12) << build_time << std::setw(12) << solve_time
+              << std::setprecision(2) << std::setw(14) << update_time * 1e6 << std::endl;
+}
+
+/**
+ * Main function to run the benchmark, the optional arguments are the largest number of trees, the seed and the
+ * number of threads of the parallel solver.
+ * @param argc Number of arguments
+ * @param argv The arguments
+ * @return 0 on success
+ */
+int main(int argc, char **argv) {
+    size_t largest = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    unsigned seed = argc > 2 ? (unsigned) std::strtoul(argv[2], nullptr, 10) : 1;
+    size_t thread_cnt = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : std::thread::hardware_concurrency();
+    std::cout << "Seconds per solve, parallel on " << thread_cnt << " threads, speedup of the flat solver over the iterative one"
+              << std::endl;
+    std::cout << std::setw(8) << "shape" << std::setw(10) << "trees" << std::setw(6) << "group" << std::setw(12)
+              << "iterative" << std::setw(12) << "recursive" << std::setw(12) << "flat" << std::setw(12) << "parallel"
+              << std::setw(11) << "speedup"
+              << std::endl;
+    for (size_t tree_cnt = 1000; tree_cnt <= largest; tree_cnt *= 10)
+        for (int group = 1; group <= 2; group++) {
+            benchmarkSolvers("random", generateRandom(tree_cnt, group, seed), thread_cnt);
+            benchmarkSolvers("path", generatePath(tree_cnt, group, seed), thread_cnt);
+        }
+
+    std::cout << std::endl << "Seconds per solve_groups" << std::endl;
+    std::cout << std::setw(8) << "shape" << std::setw(10) << "trees" << std::setw(6) << "group" << std::setw(12)
+              << "seconds" << std::setw(14) << "presents" << std::endl;
+    benchmarkGroups("random", generateRandom(largest, 1, seed));
+    benchmarkGroups("path", generatePath(largest, 1, seed));
+
+    std::cout << std::endl << "Seconds to build IncrementalSolver and to solve again, microseconds per update" << std::endl;
+    std::cout << std::setw(8) << "shape" << std::setw(10) << "trees" << std::setw(6) << "group" << std::setw(12)
+              << "build" << std::setw(12) << "solve" << std::setw(14) << "update" << std::endl;
+    for (int group = 1; group <= 3; group++) {
+        benchmarkIncremental("random", generateRandom(largest, group, seed), 100000, seed);
+        benchmarkIncremental("path", generatePath(largest, group, seed), 100, seed);
+    }
+    return 0;
+}
@@ -0,0 +1,961 @@
+#ifndef __PROGTEST__
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <limits>
+#include <optional>
+#include <algorithm>
+#include <bitset>
+#include <list>
+#include <array>
+#include <vector>
+#include <deque>
+#include <set>
+#include <map>
+#include <unordered_set>
+#include <unordered_map>
+#include <stack>
+#include <queue>
+#include <random>
+
+using ChristmasTree = size_t; // Alias for tree identifier
+
+// Structure representing the problem details for the tree problem
+struct TreeProblem {
+    int max_group_size; // Maximum group size allowed
+    std::vector<uint64_t> gifts; // Vector of gifts on each tree
+    std::vector<std::pair<ChristmasTree, ChristmasTree>> connections; // Pairs of connections between trees
+};
+
+#endif
+
+// solve_groups and the parallel solver need headers the evaluator does not include for us, so they are included in both modes
+#include <stdexcept>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+const ChristmasTree NO_TREE = std::numeric_limits<ChristmasTree>::max(); // Parent of the root of every component
+
+// Flat adjacency of the forest, the neighbours of tree i are adjacent[offsets[i]] .. adjacent[offsets[i + 1] - 1]
+struct FlatForest {
+    std::vector<size_t> offsets; // Start of the neighbours of every tree, one extra entry at the end
+    std::vector<ChristmasTree> adjacent; // Neighbours of all trees, grouped by tree
+};
+
+// Rooted view of the forest, parents always precede their children in the order
+struct RootedForest {
+    std::vector<ChristmasTree> order; // Trees in breadth-first order, component after component
+    std::vector<ChristmasTree> parent; // Parent of every tree, NO_TREE for the roots
+};
+
+// Include/exclude values of all trees, every vector is indexed by the tree
+struct FlatPresents {
+    std::vector<uint64_t> with; // The tree is collected, none of its children is
+    std::vector<uint64_t> without; // The tree is not collected
+    std::vector<uint64_t> paired; // The tree is collected together with one child, only for max_group_size == 2
+};
+
+/**
+ * Function to build the flat (CSR) adjacency of the trees by counting the degrees first.
+ * @param tree_cnt Number of trees
+ * @param connections Vector of connections between trees
+ * @return The flat adjacency
+ */
+FlatForest getFlatRepresentation(size_t tree_cnt, const std::vector<std::pair<ChristmasTree, ChristmasTree>> &connections) {
+    FlatForest forest;
+    forest.offsets.assign(tree_cnt + 1, 0);
+    for (const auto &con: connections) {
+        forest.offsets[con.first + 1]++;
+        forest.offsets[con.second + 1]++;
+    }
+    for (size_t i = 0; i < tree_cnt; i++)
+        forest.offsets[i + 1] += forest.offsets[i];
+
+    forest.adjacent.resize(forest.offsets[tree_cnt]);
+    std::vector<size_t> fill(forest.offsets.begin(), forest.offsets.end() - 1);
+    for (const auto &con: connections) {
+        forest.adjacent[fill[con.first]++] = con.second;
+        forest.adjacent[fill[con.second]++] = con.first;
+    }
+    return forest;
+}
+
+/**
+ * Function to root every component of the forest at its smallest tree and list the trees breadth-first.
+ * The order vector doubles as the queue, so the whole traversal works on preallocated arrays.
+ * @param forest The flat adjacency
+ * @return The breadth-first order and the parents
+ */
+RootedForest getRootedOrder(const FlatForest &forest) {
+    size_t tree_cnt = forest.offsets.size() - 1;
+    RootedForest rooted;
+    rooted.order.reserve(tree_cnt);
+    rooted.parent.assign(tree_cnt, NO_TREE);
+    std::vector<bool> visited(tree_cnt, false);
+
+    for (ChristmasTree root = 0; root < tree_cnt; root++) {
+        if (visited[root])
+            continue;
+        visited[root] = true;
+        size_t head = rooted.order.size();
+        rooted.order.push_back(root);
+        for (; head < rooted.order.size(); head++) {
+            ChristmasTree node = rooted.order[head];
+            for (size_t i = forest.offsets[node]; i < forest.offsets[node + 1]; i++) {
+                ChristmasTree neigh = forest.adjacent[i];
+                if (!visited[neigh]) {
+                    visited[neigh] = true;
+                    rooted.parent[neigh] = node;
+                    rooted.order.push_back(neigh);
+                }
+            }
+        }
+    }
+    return rooted;
+}
+
+/**
+ * Function to fold the values of a finished tree into its parent.
+ * @param presents The include/exclude values
+ * @param node The finished tree
+ * @param parent Its parent
+ * @param max_group_size The maximum size of the group allowed
+ */
+inline void foldIntoParent(FlatPresents &presents, ChristmasTree node, ChristmasTree parent, int max_group_size) {
+    if (max_group_size == 2) {
+        // Pairing with this child uses the parent value without the children folded so far being collected
+        presents.paired[parent] = std::max(presents.paired[parent] + presents.without[node],
+                                           presents.with[parent] + presents.with[node]);
+        presents.with[parent] += presents.without[node];
+        presents.without[parent] += std::max(std::max(presents.with[node], presents.without[node]), presents.paired[node]);
+    } else {
+        presents.with[parent] += presents.without[node];
+        presents.without[parent] += std::max(presents.with[node], presents.without[node]);
+    }
+}
+
+/**
+ * Function to evaluate the include/exclude values in a single sweep from the last tree of the order to the first.
+ * Every tree is finished once the sweep reaches it, because all of its children come after it in the order.
+ * paired starts at zero instead of an invalid marker, zero plus the excluded children never beats without.
+ * @param rooted The breadth-first order and the parents
+ * @param gifts Vector of gifts on each tree
+ * @param max_group_size The maximum size of the group allowed
+ * @return The maximum presents that can be collected, summed over all components
+ */
+uint64_t solve_flat(const RootedForest &rooted, const std::vector<uint64_t> &gifts, int max_group_size) {
+    FlatPresents presents;
+    presents.with = gifts;
+    presents.without.assign(gifts.size(), 0);
+    if (max_group_size == 2)
+        presents.paired.assign(gifts.size(), 0);
+
+    uint64_t max_presents = 0;
+    for (size_t i = rooted.order.size(); i-- > 0;) {
+        ChristmasTree node = rooted.order[i];
+        ChristmasTree parent = rooted.parent[node];
+        if (parent != NO_TREE) {
+            foldIntoParent(presents, node, parent, max_group_size);
+            continue;
+        }
+        uint64_t best = std::max(presents.with[node], presents.without[node]);
+        if (max_group_size == 2)
+            best = std::max(best, presents.paired[node]);
+        max_presents += best;
+    }
+    return max_presents;
+}
+
+const int MAX_GROUP_SIZE = 8; // Largest group size handled by solve_groups
+
+/**
+ * Function to merge the group states of a finished child into its parent. Only the group sizes that both subtrees can
+ * reach are combined, and the sizes of the subtrees are clipped to the maximum group size, so by the usual tree
+ * knapsack argument all merges of a forest cost O(n * K) together.
+ * @param merged States of the parent, valid up to merged_size
+ * @param merged_size Trees of the parent and the children merged so far, clipped to max_group_size
+ * @param child States of the child, valid up to child_size
+ * @param child_size Trees of the subtree of the child, clipped to max_group_size
+ * @param max_group_size The maximum size of the group allowed
+ * @return The clipped size after the merge
+ */
+inline int mergeGroups(uint64_t *merged, int merged_size, const uint64_t *child, int child_size, int max_group_size) {
+    int limit = std::min(max_group_size, merged_size + child_size);
+    // Larger sizes first, so the smaller ones still hold the values without this child
+    if (child_size == 1) {
+        // A leaf either joins the group of its parent or is left out, by far the most common merge
+        for (int size = limit; size >= 2; size--)
+            merged[size] = std::max(size <= merged_size ? merged[size] + child[0] : 0, merged[size - 1] + child[1]);
+        merged[1] += child[0];
+    } else
+        for (int size = limit; size >= 1; size--) {
+            uint64_t value = 0;
+            for (int own = std::max(1, size - child_size); own <= std::min(size, merged_size); own++)
+                value = std::max(value, merged[own] + child[size - own]);
+            merged[size] = value;
+        }
+    merged[0] += *std::max_element(child, child + child_size + 1);
+    return limit;
+}
+
+/**
+ * Function to evaluate the DP for any group size up to K in a single sweep from the last tree of the order to the first.
+ * groups[node][0] is the best value of the subtree without the tree, groups[node][s] the best value with the tree
+ * collected in a group of s trees of its subtree, for every s up to the clipped size of the subtree.
+ * @tparam K The maximum size of the group allowed
+ * @param rooted The breadth-first order and the parents
+ * @param gifts Vector of gifts on each tree
+ * @return The maximum presents that can be collected, summed over all components
+ */
+template <int K>
+uint64_t solve_group_size(const RootedForest &rooted, const std::vector<uint64_t> &gifts) {
+    std::vector<std::array<uint64_t, K + 1>> groups(gifts.size());
+    std::vector<uint8_t> sizes(gifts.size(), 1); // Trees of every subtree merged so far, clipped to K
+    for (ChristmasTree node = 0; node < gifts.size(); node++)
+        groups[node][1] = gifts[node];
+
+    uint64_t max_presents = 0;
+    for (size_t i = rooted.order.size(); i-- > 0;) {
+        ChristmasTree node = rooted.order[i];
+        ChristmasTree parent = rooted.parent[node];
+        if (parent == NO_TREE)
+            max_presents += *std::max_element(groups[node].begin(), groups[node].end());
+        else
+            sizes[parent] = mergeGroups(groups[parent].data(), sizes[parent], groups[node].data(), sizes[node], K);
+    }
+    return max_presents;
+}
+
+// Solver of the group DP for a group size known only at runtime
+using GroupSolver = uint64_t (*)(const RootedForest &, const std::vector<uint64_t> &);
+
+// Instantiation of solve_group_size for every group size, GROUP_SOLVERS[K - 1] handles K
+const std::array<GroupSolver, MAX_GROUP_SIZE> GROUP_SOLVERS = {
+        solve_group_size<1>, solve_group_size<2>, solve_group_size<3>, solve_group_size<4>,
+        solve_group_size<5>, solve_group_size<6>, solve_group_size<7>, solve_group_size<8>,
+};
+
+/**
+ * Function to solve the TreeProblem for any group size from 1 to MAX_GROUP_SIZE, in O(n * K) time and memory.
+ * @param treeProblem The problem instance containing the group size, gifts, and connections
+ * @return The maximum presents that can be collected
+ */
+uint64_t solve_groups(const TreeProblem &treeProblem) {
+    if (treeProblem.max_group_size < 1 || treeProblem.max_group_size > MAX_GROUP_SIZE)
+        throw std::out_of_range("group size is not supported");
+    FlatForest forest = getFlatRepresentation(treeProblem.gifts.size(), treeProblem.connections);
+    RootedForest rooted = getRootedOrder(forest);
+    return GROUP_SOLVERS[treeProblem.max_group_size - 1](rooted, treeProblem.gifts);
+}
+
+/**
+ * Function to solve the TreeProblem on flat arrays, in time linear in the number of trees and connections.
+ * Group sizes above 2 are handed to solve_groups.
+ * @param treeProblem The problem instance containing the group size, gifts, and connections
+ * @return The maximum presents that can be collected
+ */
+uint64_t solve(const TreeProblem &treeProblem) {
+    if (treeProblem.max_group_size > 2)
+        return solve_groups(treeProblem);
+    FlatForest forest = getFlatRepresentation(treeProblem.gifts.size(), treeProblem.connections);
+    RootedForest rooted = getRootedOrder(forest);
+    return solve_flat(rooted, treeProblem.gifts, treeProblem.max_group_size);
+}
+
+const size_t SPLIT_GRAIN = 4096; // Trees a task of the parallel solver collects before its root is cut off
+const size_t NO_TASK = std::numeric_limits<size_t>::max(); // Parent of the tasks holding whole components
+
+// Depth-first preorder of the forest, the subtree of the tree at position p takes positions p .. p + size[p] - 1
+struct PreorderForest {
+    std::vector<size_t> parent; // Position of the parent of every position, NO_TREE for the roots
+    std::vector<size_t> size; // Number of trees in the subtree of every position
+    std::vector<size_t> roots; // Positions of the roots of all components, ascending
+    std::vector<uint64_t> gifts; // Gifts on the tree at every position
+};
+
+// Part of the forest evaluated by one task, the subtrees of its child tasks are left out
+struct SubtreeTask {
+    size_t begin; // Position of the root of the subtree, or of the first root of a run of small components
+    size_t end; // Position after the last tree
+    size_t parent; // Task holding the parent of the root, NO_TASK for whole components
+};
+
+// Shared state of the parallel solver, every worker owns one queue and steals from the front of the others
+struct ParallelForest {
+    const PreorderForest &preorder; // The depth-first preorder
+    int max_group_size; // Maximum group size allowed
+    FlatPresents presents; // Include/exclude values of every position, written by the task holding the position
+    std::vector<SubtreeTask> tasks; // All tasks, ascending by their first position
+    std::vector<size_t> child_offsets; // Start of the child tasks of every task, one extra entry at the end
+    std::vector<size_t> child_tasks; // Child tasks of all tasks, grouped by task, ascending
+    std::vector<std::atomic<size_t>> pending; // Child tasks that every task still waits for
+    std::vector<std::deque<size_t>> queues; // Ready tasks of every worker
+    std::vector<std::mutex> locks; // Lock of every queue
+    std::atomic<size_t> unfinished; // Tasks not evaluated yet
+    std::vector<uint64_t> sums; // Presents of the components finished by every worker
+
+    ParallelForest(const PreorderForest &preorder, int max_group_size, size_t thread_cnt)
+            : preorder(preorder), max_group_size(max_group_size), queues(thread_cnt), locks(thread_cnt), unfinished(0),
+              sums(thread_cnt, 0) {
+        presents.with = preorder.gifts;
+        presents.without.assign(preorder.gifts.size(), 0);
+        if (max_group_size == 2)
+            presents.paired.assign(preorder.gifts.size(), 0);
+    }
+};
+
+/**
+ * Function to list the trees in depth-first preorder with an explicit stack, so that every subtree is a range.
+ * @param forest The flat adjacency
+ * @param gifts Vector of gifts on each tree
+ * @return The parents, subtree sizes, roots and gifts by position
+ */
+PreorderForest getPreorder(const FlatForest &forest, const std::vector<uint64_t> &gifts) {
+    size_t tree_cnt = gifts.size();
+    PreorderForest preorder;
+    preorder.parent.resize(tree_cnt);
+    preorder.size.assign(tree_cnt, 1);
+    preorder.gifts.resize(tree_cnt);
+    std::vector<bool> visited(tree_cnt, false);
+    std::vector<std::pair<ChristmasTree, size_t>> stack; // Trees waiting for their position, with the one of their parent
+
+    size_t next = 0;
+    for (ChristmasTree root = 0; root < tree_cnt; root++) {
+        if (visited[root])
+            continue;
+        visited[root] = true;
+        preorder.roots.push_back(next);
+        stack.emplace_back(root, NO_TREE);
+        while (!stack.empty()) {
+            auto [node, parent] = stack.back();
+            stack.pop_back();
+            preorder.parent[next] = parent;
+            preorder.gifts[next] = gifts[node];
+            for (size_t i = forest.offsets[node]; i < forest.offsets[node + 1]; i++) {
+                ChristmasTree neigh = forest.adjacent[i];
+                if (!visited[neigh]) {
+                    visited[neigh] = true;
+                    stack.emplace_back(neigh, next);
+                }
+            }
+            next++;
+        }
+    }
+    for (size_t pos = tree_cnt; pos-- > 0;)
+        if (preorder.parent[pos] != NO_TREE)
+            preorder.size[preorder.parent[pos]] += preorder.size[pos];
+    return preorder;
+}
+
+/**
+ * Function to cut the forest into subtree tasks. Going up from the last position, every tree collects the trees of its
+ * children that are not cut off yet, and once it has SPLIT_GRAIN of them, it is cut off as the root of a task whose
+ * parent task holds the parent of the tree. A heavy subtree is therefore split into tasks of about SPLIT_GRAIN trees,
+ * and paths hanging from the same tree become chains of tasks that run side by side. Consecutive components too small
+ * to be cut off are grouped into one task until the group has SPLIT_GRAIN trees.
+ * @param state The shared state, its tasks and pending counters are filled in
+ */
+void splitSubtrees(ParallelForest &state) {
+    const PreorderForest &preorder = state.preorder;
+    std::vector<size_t> rest(preorder.parent.size(), 1); // Trees of the subtree not cut off yet
+    std::vector<size_t> cuts;
+    for (size_t pos = rest.size(); pos-- > 0;) {
+        if (rest[pos] >= SPLIT_GRAIN)
+            cuts.push_back(pos);
+        else if (preorder.parent[pos] != NO_TREE)
+            rest[preorder.parent[pos]] += rest[pos];
+    }
+    std::reverse(cuts.begin(), cuts.end());
+
+    // The roots and cuts in ascending order, every task is the child of the innermost task containing its root
+    std::vector<size_t> open; // Tasks containing the current position, the innermost last
+    size_t group = NO_TASK, group_rest = 0; // Task collecting the current run of small components and its trees
+    for (size_t r = 0, c = 0; r < preorder.roots.size() || c < cuts.size();) {
+        bool root = r < preorder.roots.size() && (c == cuts.size() || preorder.roots[r] <= cuts[c]);
+        size_t pos = root ? preorder.roots[r++] : cuts[c++];
+        if (root && c < cuts.size() && cuts[c] == pos)
+            c++;
+        bool small = root && rest[pos] < SPLIT_GRAIN;
+        bool joined = small && group != NO_TASK && group_rest < SPLIT_GRAIN;
+        if (joined) {
+            state.tasks[group].end = pos + preorder.size[pos];
+            group_rest += rest[pos];
+        }
+        while (!open.empty() && state.tasks[open.back()].end <= pos)
+            open.pop_back();
+        if (joined)
+            continue;
+        state.tasks.push_back({pos, pos + preorder.size[pos], open.empty() ? NO_TASK : open.back()});
+        open.push_back(state.tasks.size() - 1);
+        if (root) {
+            group = small ? state.tasks.size() - 1 : NO_TASK;
+            group_rest = rest[pos];
+        }
+    }
+
+    size_t task_cnt = state.tasks.size();
+    state.child_offsets.assign(task_cnt + 1, 0);
+    for (const auto &task: state.tasks)
+        if (task.parent != NO_TASK)
+            state.child_offsets[task.parent + 1]++;
+    for (size_t i = 0; i < task_cnt; i++)
+        state.child_offsets[i + 1] += state.child_offsets[i];
+    state.child_tasks.resize(state.child_offsets[task_cnt]);
+    std::vector<size_t> fill(state.child_offsets.begin(), state.child_offsets.end() - 1);
+    for (size_t task = 0; task < task_cnt; task++)
+        if (state.tasks[task].parent != NO_TASK)
+            state.child_tasks[fill[state.tasks[task].parent]++] = task;
+
+    state.pending = std::vector<std::atomic<size_t>>(task_cnt);
+    size_t ready = 0;
+    for (size_t task = 0; task < task_cnt; task++) {
+        size_t children = state.child_offsets[task + 1] - state.child_offsets[task];
+        state.pending[task].store(children, std::memory_order_relaxed);
+        if (!children)
+            state.queues[ready++ % state.queues.size()].push_back(task);
+    }
+    state.unfinished.store(task_cnt);
+}
+
+/**
+ * Function to evaluate one task in a sweep from its last position to its first, like solve_flat.
+ * The subtrees of the child tasks are skipped, and the root of each of them is folded into its parent when the
+ * sweep passes it. The root of the task itself is folded in by the parent task in the same way.
+ * @param state The shared state
+ * @param task The task, all of its child tasks are finished
+ * @param worker Index of the calling worker
+ */
+void runTask(ParallelForest &state, size_t task, size_t worker) {
+    const SubtreeTask &current = state.tasks[task];
+    const auto &parent = state.preorder.parent;
+    FlatPresents &presents = state.presents;
+    uint64_t max_presents = 0;
+    size_t pos = current.end;
+    for (size_t k = state.child_offsets[task + 1];; k--) {
+        size_t stop = k > state.child_offsets[task] ? state.tasks[state.child_tasks[k - 1]].end : current.begin;
+        for (; pos > stop; pos--) {
+            size_t node = pos - 1;
+            if (parent[node] == NO_TREE) {
+                uint64_t best = std::max(presents.with[node], presents.without[node]);
+                if (state.max_group_size == 2)
+                    best = std::max(best, presents.paired[node]);
+                max_presents += best;
+            } else if (node != current.begin)
+                foldIntoParent(presents, node, parent[node], state.max_group_size);
+        }
+        if (k == state.child_offsets[task])
+            break;
+        pos = state.tasks[state.child_tasks[k - 1]].begin;
+        foldIntoParent(presents, pos, parent[pos], state.max_group_size);
+    }
+    state.sums[worker] += max_presents;
+}
+
+/**
+ * Function to run a task and report it to its parent task, the last child task to finish runs the parent right away.
+ * @param state The shared state
+ * @param task The task
+ * @param worker Index of the calling worker
+ */
+void completeTask(ParallelForest &state, size_t task, size_t worker) {
+    while (true) {
+        runTask(state, task, worker);
+        state.unfinished.fetch_sub(1, std::memory_order_relaxed);
+        size_t parent = state.tasks[task].parent;
+        if (parent == NO_TASK || state.pending[parent].fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+        task = parent;
+    }
+}
+
+/**
+ * Function to take a task, the own queue is used from the back and the others are stolen from at the front.
+ * @param state The shared state
+ * @param worker Index of the calling worker
+ * @param task Where to store the task
+ * @return Whether a task was found
+ */
+bool takeTask(ParallelForest &state, size_t worker, size_t &task) {
+    size_t thread_cnt = state.queues.size();
+    for (size_t k = 0; k < thread_cnt; k++) {
+        size_t victim = (worker + k) % thread_cnt;
+        std::lock_guard<std::mutex> lock(state.locks[victim]);
+        auto &queue = state.queues[victim];
+        if (queue.empty())
+            continue;
+        if (victim == worker) {
+            task = queue.back();
+            queue.pop_back();
+        } else {
+            task = queue.front();
+            queue.pop_front();
+        }
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Function to solve the TreeProblem with a work-stealing pool of subtree tasks. The forest is listed in depth-first
+ * preorder and cut into tasks by splitSubtrees. A task waits for its child tasks, evaluates its own trees and leaves
+ * the values of its root for the parent task, which merges them at the cut vertex. Sums and maxima of integers do not
+ * depend on the order they are taken in, so the result is always the one of solve.
+ * @param treeProblem The problem instance containing the group size, gifts, and connections
+ * @param thread_cnt Number of threads, a single thread runs solve, as do group sizes above 2
+ * @return The maximum presents that can be collected
+ */
+uint64_t solve_parallel(const TreeProblem &treeProblem, size_t thread_cnt = std::thread::hardware_concurrency()) {
+    if (thread_cnt <= 1 || treeProblem.gifts.empty() || treeProblem.max_group_size > 2)
+        return solve(treeProblem);
+    FlatForest forest = getFlatRepresentation(treeProblem.gifts.size(), treeProblem.connections);
+    PreorderForest preorder = getPreorder(forest, treeProblem.gifts);
+    ParallelForest state(preorder, treeProblem.max_group_size, thread_cnt);
+    splitSubtrees(state);
+
+    auto work = [&state](size_t worker) {
+        size_t task;
+        while (state.unfinished.load(std::memory_order_relaxed)) {
+            if (takeTask(state, worker, task))
+                completeTask(state, task, worker);
+            else
+                std::this_thread::yield();
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t worker = 1; worker < std::min(thread_cnt, state.tasks.size()); worker++)
+        threads.emplace_back(work, worker);
+    work(0);
+    for (auto &thread: threads)
+        thread.join();
+
+    uint64_t max_presents = 0;
+    for (uint64_t sum: state.sums)
+        max_presents += sum;
+    return max_presents;
+}
+
+// Solver keeping the rooted DP of a forest, so that changing the gifts of one tree only recomputes its ancestors
+class IncrementalSolver {
+public:
+    /**
+     * Constructor solving the problem once and keeping the values of every tree.
+     * @param treeProblem The problem instance containing the group size, gifts, and connections
+     */
+    explicit IncrementalSolver(const TreeProblem &treeProblem)
+            : max_group_size(treeProblem.max_group_size), gifts(treeProblem.gifts),
+              forest(getFlatRepresentation(gifts.size(), treeProblem.connections)), rooted(getRootedOrder(forest)) {
+        if (max_group_size < 1 || max_group_size > MAX_GROUP_SIZE)
+            throw std::out_of_range("group size is not supported");
+        total = 0;
+        if (max_group_size > 2) {
+            groups.resize(gifts.size() * (max_group_size + 1));
+            group_sizes.resize(gifts.size());
+            for (size_t i = rooted.order.size(); i-- > 0;) {
+                ChristmasTree node = rooted.order[i];
+                mergeChildren(node);
+                if (rooted.parent[node] == NO_TREE)
+                    total += bestGroup(node);
+            }
+            return;
+        }
+        presents.with = gifts;
+        presents.without.assign(gifts.size(), 0);
+        presents.paired.assign(gifts.size(), 0);
+        best_child.assign(gifts.size(), NO_TREE);
+        for (size_t i = rooted.order.size(); i-- > 0;) {
+            ChristmasTree node = rooted.order[i];
+            ChristmasTree parent = rooted.parent[node];
+            updatePaired(node); // All children of the tree are folded in by now
+            if (parent == NO_TREE) {
+                total += best(node);
+                continue;
+            }
+            presents.with[parent] += presents.without[node];
+            presents.without[parent] += best(node);
+            if (betterChild(node, best_child[parent]))
+                best_child[parent] = node;
+        }
+    }
+
+    /**
+     * Method to get the maximum presents of the current gifts.
+     * @return The maximum presents that can be collected
+     */
+    uint64_t result() const {
+        return total;
+    }
+
+    /**
+     * Method to change the gifts on one tree and recompute the values on the path to the root of its component.
+     * The walk stops at the first tree whose values do not change. For max_group_size <= 2 a parent is updated in O(1)
+     * from the old and new values of the child, except when its best child gets worse and findBestChild scans all of
+     * its children. Group sizes above 2 merge all children of every tree on the path again, in O(deg * K^2) per tree.
+     * A tree with many children on the path, like the centre of a star, therefore costs O(deg) when its best child gets
+     * worse, and on every update for group sizes above 2.
+     * @param tree The tree
+     * @param gift The new number of gifts on it
+     * @return The maximum presents that can be collected with the new gifts
+     */
+    uint64_t update(ChristmasTree tree, uint64_t gift) {
+        if (max_group_size > 2) {
+            gifts[tree] = gift;
+            for (ChristmasTree node = tree; node != NO_TREE; node = rooted.parent[node]) {
+                GroupValues before = group(node);
+                mergeChildren(node);
+                if (group(node) == before)
+                    break;
+                if (rooted.parent[node] == NO_TREE)
+                    total = total - *std::max_element(before.begin(), before.end()) + bestGroup(node);
+            }
+            return total;
+        }
+        TreeValues before = values(tree);
+        presents.with[tree] = presents.with[tree] - gifts[tree] + gift;
+        gifts[tree] = gift;
+        updatePaired(tree);
+
+        for (ChristmasTree node = tree;;) {
+            TreeValues after = values(node);
+            if (after == before)
+                break;
+            ChristmasTree parent = rooted.parent[node];
+            if (parent == NO_TREE) {
+                total = total - std::max(std::max(before[0], before[1]), before[2]) + best(node);
+                break;
+            }
+            TreeValues parent_before = values(parent);
+            presents.with[parent] = presents.with[parent] - before[1] + after[1];
+            presents.without[parent] = presents.without[parent] - std::max(std::max(before[0], before[1]), before[2])
+                                       + best(node);
+            if (best_child[parent] == node) {
+                // The best child stays the best unless its gain with - without dropped, then another one may beat it
+                if (after[0] + before[1] < before[0] + after[1])
+                    best_child[parent] = findBestChild(parent);
+            } else if (betterChild(node, best_child[parent]))
+                best_child[parent] = node;
+            updatePaired(parent);
+            before = parent_before;
+            node = parent;
+        }
+        return total;
+    }
+
+private:
+    using TreeValues = std::array<uint64_t, 3>; // with, without and paired of one tree
+    using GroupValues = std::array<uint64_t, MAX_GROUP_SIZE + 1>; // Group states of one tree, unused sizes are zero
+
+    int max_group_size; // Maximum group size allowed
+    std::vector<uint64_t> gifts; // Current gifts on each tree
+    FlatForest forest; // The flat adjacency
+    RootedForest rooted; // The breadth-first order and the parents
+    FlatPresents presents; // Include/exclude values of every tree
+    std::vector<ChristmasTree> best_child; // Child gaining the most when paired with its parent, NO_TREE for a leaf
+    std::vector<uint64_t> groups; // States of solve_group_size for group sizes above 2, max_group_size + 1 per tree
+    std::vector<uint8_t> group_sizes; // Trees of every subtree, clipped to max_group_size
+    uint64_t total; // Maximum presents summed over the components
+
+    /**
+     * Method to get the values of a tree.
+     * @param node The tree
+     * @return Its with, without and paired values
+     */
+    TreeValues values(ChristmasTree node) const {
+        return {presents.with[node], presents.without[node], presents.paired[node]};
+    }
+
+    /**
+     * Method to get the best value of a tree, paired is zero unless max_group_size == 2.
+     * @param node The tree
+     * @return The best value of its subtree
+     */
+    uint64_t best(ChristmasTree node) const {
+        return std::max(std::max(presents.with[node], presents.without[node]), presents.paired[node]);
+    }
+
+    /**
+     * Method to copy the group states of a tree.
+     * @param node The tree
+     * @return Its states, padded with zeros
+     */
+    GroupValues group(ChristmasTree node) const {
+        GroupValues values{};
+        std::copy_n(groups.begin() + node * (max_group_size + 1), max_group_size + 1, values.begin());
+        return values;
+    }
+
+    /**
+     * Method to get the best group state of a tree.
+     * @param node The tree
+     * @return The best value of its subtree
+     */
+    uint64_t bestGroup(ChristmasTree node) const {
+        auto first = groups.begin() + node * (max_group_size + 1);
+        return *std::max_element(first, first + max_group_size + 1);
+    }
+
+    /**
+     * Method to calculate the group states of a tree from its gifts and the states of all its children,
+     * merged by mergeGroups like in solve_group_size, in O(deg * K^2) at worst.
+     * @param node The tree
+     */
+    void mergeChildren(ChristmasTree node) {
+        uint64_t *merged = &groups[node * (max_group_size + 1)];
+        std::fill_n(merged, max_group_size + 1, 0);
+        merged[1] = gifts[node];
+        int merged_size = 1;
+        for (size_t i = forest.offsets[node]; i < forest.offsets[node + 1]; i++) {
+            ChristmasTree neigh = forest.adjacent[i];
+            if (neigh != rooted.parent[node])
+                merged_size = mergeGroups(merged, merged_size, &groups[neigh * (max_group_size + 1)], group_sizes[neigh],
+                                          max_group_size);
+        }
+        group_sizes[node] = merged_size;
+    }
+
+    /**
+     * Method to compare what two children gain by being collected together with their parent.
+     * @param child The child
+     * @param other The other child or NO_TREE
+     * @return Whether child gains more than other
+     */
+    bool betterChild(ChristmasTree child, ChristmasTree other) const {
+        if (max_group_size != 2)
+            return false;
+        if (other == NO_TREE)
+            return true;
+        // with - without compared without leaving the unsigned range
+        return presents.with[child] + presents.without[other] > presents.with[other] + presents.without[child];
+    }
+
+    /**
+     * Method to find the child that gains the most by being paired, scanning all children of the tree in O(deg).
+     * @param node The tree
+     * @return The best child, NO_TREE for a leaf
+     */
+    ChristmasTree findBestChild(ChristmasTree node) const {
+        ChristmasTree found = NO_TREE;
+        for (size_t i = forest.offsets[node]; i < forest.offsets[node + 1]; i++)
+            if (forest.adjacent[i] != rooted.parent[node] && betterChild(forest.adjacent[i], found))
+                found = forest.adjacent[i];
+        return found;
+    }
+
+    /**
+     * Method to recompute the paired value of a tree from its with value and its best child.
+     * Pairing swaps the without value of that child in with for its own with value.
+     * @param node The tree
+     */
+    void updatePaired(ChristmasTree node) {
+        ChristmasTree child = best_child[node];
+        presents.paired[node] = child == NO_TREE ? 0 : presents.with[node] - presents.without[child] + presents.with[child];
+    }
+};
+
+#ifndef __PROGTEST__
+
+using TestCase = std::pair<uint64_t, TreeProblem>; // Alias for a test case
+
+// Basic test cases for the TreeProblem
+const std::vector<TestCase> BASIC_TESTS = {
+        {37,  {2, {2,  3,  4,  5,  6,  7,  8,  9}, {{0,  1},  {1,  2},  {2,  3},  {3,  4},  {3, 5}, {3,  6},  {6,  7}}}},
+
+
+        {3,   {1, {1,  1,  1,  2},                 {{0,  3},  {1,  3},  {2,  3}}}},
+        {4,   {1, {1,  1,  1,  4},                 {{0,  3},  {1,  3},  {2,  3}}}},
+        {57,  {1, {
+                   17, 11, 5,  13, 8,  12, 7,  4,  2,  8,
+                  },                               {
+                                                    {1,  4},  {6,  1},  {2,  1},  {3,  8},  {8, 0}, {6,  0},  {5,  6}, {7,  2},  {0,  9},
+                                                   }}},
+        {85,  {1, {
+                   10, 16, 13, 4,  19, 8,  18, 17, 18, 19, 10,
+                  },                               {
+                                                    {9,  7},  {9,  6},  {10, 4},  {4,  9},  {7, 1}, {0,  2},  {9,  2}, {3,  8},  {2,  3}, {5, 4},
+                                                   }}},
+        {79,  {1, {
+                   8,  14, 11, 8,  1,  13, 9,  14, 15, 12, 1,  11,
+                  },                               {
+                                                    {9,  1},  {1,  2},  {1,  4},  {5,  10}, {7, 8}, {3,  7},  {11, 3}, {11, 10}, {6,  8}, {0, 1}, {0,  3},
+                                                   }}},
+        {102, {1, {
+                   15, 10, 18, 18, 3,  4,  18, 12, 6,  19, 9,  19, 10,
+                  },                               {
+                                                    {10, 2},  {11, 10}, {6,  3},  {10, 8},  {5, 3}, {11, 1},  {9,  5}, {0,  4},  {12, 3}, {9, 7}, {11, 9}, {4, 12},
+                                                   }}},
+        {93,  {1, {
+                   1,  7,  6,  18, 15, 2,  14, 15, 18, 8,  15, 1,  5, 6,
+                  },                               {
+                                                    {0,  13}, {6,  12}, {0,  12}, {7,  8},  {8, 3}, {12, 11}, {12, 1}, {10, 12}, {2,  6}, {6, 9}, {12, 7},
+                                                                                                                                                           {0, 4}, {0, 5},
+                                                   }}},
+};
+
+// Bonus test cases for additional verification
+const std::vector<TestCase> BONUS_TESTS = {
+        {3, {2, {1, 1, 1, 2}, {{0, 3}, {1, 3}, {2, 3}}}},
+        {5, {2, {1, 1, 1, 4}, {{0, 3}, {1, 3}, {2, 3}}}},
+};
+
+// Forests, single trees and pairs that only the flat solver handles component by component
+const std::vector<TestCase> FOREST_TESTS = {
+        {7,  {1, {7},                   {}}},
+        {9,  {2, {4, 5},                {{0, 1}}}},
+        {9,  {1, {1, 1, 1, 2, 4, 6},    {{0, 3}, {1, 3}, {2, 3}, {4, 5}}}},
+        {16, {2, {1, 1, 1, 4, 5, 6, 2}, {{0, 3}, {1, 3}, {2, 3}, {4, 5}, {5, 6}}}},
+};
+
+// Larger groups, checked against every selection of trees
+const std::vector<TestCase> GROUP_TESTS = {
+        {6,  {3, {1, 1, 1, 1, 1, 1, 1},  {{0, 1}, {1, 2}, {2, 3}, {3, 4}, {4, 5}, {5, 6}}}},
+        {5,  {3, {1, 1, 1, 1, 1, 1},     {{0, 1}, {0, 2}, {0, 3}, {0, 4}, {0, 5}}}},
+        {12, {3, {10, 1, 1, 1, 1, 1},    {{0, 1}, {0, 2}, {0, 3}, {0, 4}, {0, 5}}}},
+        {11, {4, {2, 2, 2, 2, 2, 3},     {{0, 1}, {1, 2}, {2, 3}, {3, 4}}}},
+        {8,  {8, {1, 1, 1, 1, 1, 1, 1, 1, 1}, {{0, 1}, {1, 2}, {2, 3}, {3, 4}, {4, 5}, {5, 6}, {6, 7}, {7, 8}}}},
+        {35, {5, {9, 1, 8, 2, 7, 3, 6},  {{0, 1}, {1, 2}, {1, 3}, {3, 4}, {3, 5}, {5, 6}}}},
+};
+
+/**
+ * Function to run the test cases and verify the correctness of the solve function.
+ * @param T Vector of test cases
+ */
+void test(const std::vector<TestCase> &T) {
+    int i = 0;
+    for (auto &[s, t]: T) {
+        for (uint64_t result: {solve(t), solve_parallel(t, 4)})
+            if (s != result)
+                std::cout << "Error in " << i << " (returned " << std::endl << result << ")" << std::endl;
+        i++;
+    }
+    std::cout << "Finished" << std::endl;
+}
+
+/**
+ * Function to check solve_groups on the tests with group sizes 1 and 2 and its range of group sizes.
+ */
+void testGroups() {
+    for (const auto &tests: {BASIC_TESTS, BONUS_TESTS, FOREST_TESTS})
+        for (auto &[s, t]: tests)
+            assert(solve_groups(t) == s);
+    bool thrown = false;
+    try {
+        solve_groups({MAX_GROUP_SIZE + 1, {1}, {}});
+    } catch (const std::out_of_range &) {
+        thrown = true;
+    }
+    assert(thrown);
+    std::cout << "Finished" << std::endl;
+}
+
+/**
+ * Function to check a path of a million trees, deeper than any call stack would allow.
+ * Collecting every other tree is optimal for group size 1 and two of every three for group size 2.
+ */
+void testDeepPath() {
+    TreeProblem path{1, std::vector<uint64_t>(1000000, 1), {}};
+    for (ChristmasTree i = 1; i < path.gifts.size(); i++)
+        path.connections.emplace_back(i - 1, i);
+    assert(solve(path) == 500000);
+    assert(solve_parallel(path, 4) == 500000);
+    path.max_group_size = 2;
+    assert(solve(path) == 666667);
+    assert(solve_parallel(path, 4) == 666667);
+    std::cout << "Finished" << std::endl;
+}
+
+/**
+ * Function to compare the incremental solver with solving from scratch after every change of the gifts.
+ */
+void testIncremental() {
+    for (auto &[s, t]: GROUP_TESTS) {
+        IncrementalSolver solver(t);
+        assert(solver.result() == s);
+    }
+    std::mt19937 rng(11);
+    // The best leaf of a star gets better and worse, the other leaves overtake it
+    TreeProblem star{2, {0}, {}};
+    for (ChristmasTree i = 1; i <= 1000; i++) {
+        star.gifts.push_back(rng() % 100);
+        star.connections.emplace_back(0, i);
+    }
+    IncrementalSolver star_solver(star);
+    for (int k = 0; k < 300; k++) {
+        ChristmasTree tree = k % 2 ? std::max_element(star.gifts.begin() + 1, star.gifts.end()) - star.gifts.begin()
+                                   : 1 + rng() % 1000;
+        star.gifts[tree] = rng() % 200;
+        assert(star_solver.update(tree, star.gifts[tree]) == solve(star));
+    }
+    for (int group = 1; group <= MAX_GROUP_SIZE; group++)
+        for (size_t component: {7, 2000}) {
+            TreeProblem forest{group, {}, {}};
+            for (ChristmasTree i = 0; i < 2000; i++) {
+                forest.gifts.push_back(rng() % 100);
+                if (i % component)
+                    forest.connections.emplace_back(rng() % 2 ? i - 1 : i / component * component + rng() % (i % component), i);
+            }
+            IncrementalSolver solver(forest);
+            assert(solver.result() == solve(forest));
+            for (int k = 0; k < 300; k++) {
+                ChristmasTree tree = rng() % forest.gifts.size();
+                forest.gifts[tree] = rng() % 3 ? rng() % 100 : 0;
+                assert(solver.update(tree, forest.gifts[tree]) == solve(forest));
+            }
+        }
+    std::cout << "Finished" << std::endl;
+}
+
+/**
+ * Function to compare the parallel solver with the sequential one on random forests of bushy and deep trees.
+ */
+void testParallel() {
+    std::mt19937 rng(7);
+    for (int group = 1; group <= 2; group++)
+        for (size_t component: {1, 50, 1000, 300000}) {
+            TreeProblem forest{group, {}, {}};
+            for (ChristmasTree i = 0; i < 300000; i++) {
+                forest.gifts.push_back(rng() % 1000);
+                // Every tree joins a random earlier tree of its component, or the previous one to make long paths
+                if (i % component)
+                    forest.connections.emplace_back(rng() % 2 ? i - 1 : i - rng() % (i % component) - 1, i);
+            }
+            std::shuffle(forest.connections.begin(), forest.connections.end(), rng);
+            uint64_t expected = solve(forest);
+            for (size_t thread_cnt: {2, 3, 8})
+                assert(solve_parallel(forest, thread_cnt) == expected);
+        }
+    // Paths hanging from one tree are split into chains of tasks, with small components around them
+    for (int group = 1; group <= 2; group++)
+        for (size_t legs: {1, 4, 100}) {
+            TreeProblem spider{group, {rng() % 1000u}, {}};
+            for (size_t leg = 0; leg < legs; leg++)
+                for (size_t i = 0; i < 100000 / legs; i++) {
+                    spider.connections.emplace_back(i ? spider.gifts.size() - 1 : 0, spider.gifts.size());
+                    spider.gifts.push_back(rng() % 1000);
+                }
+            for (size_t i = 0; i < 5000; i++)
+                spider.gifts.push_back(rng() % 1000);
+            uint64_t expected = solve(spider);
+            for (size_t thread_cnt: {2, 4})
+                assert(solve_parallel(spider, thread_cnt) == expected);
+        }
+    std::cout << "Finished" << std::endl;
+}
+
+/**
+ * Main function to execute the test cases.
+ * @return 0 if all tests pass
+ */
+int main() {
+    test(BASIC_TESTS);
+    test(BONUS_TESTS);
+    test(FOREST_TESTS);
+    test(GROUP_TESTS);
+    testGroups();
+    testDeepPath();
+    testParallel();
+    testIncremental();
+}
+
+#endif
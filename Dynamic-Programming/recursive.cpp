@@ -44,62 +44,133 @@ void getGraphRepresentation(const std::vector<std::pair<ChristmasTree, Christmas
     }
 }
 
+const ChristmasTree NO_TREE = std::numeric_limits<ChristmasTree>::max(); // Predecessor of the root
+
+// Way of walking the tree, the explicit stack handles trees of any depth
+enum class Traversal {
+    RECURSIVE,
+    EXPLICIT_STACK
+};
+
+/**
+ * Function to calculate the presents of a node once all of its children are finished.
+ * The first value includes the node without any collected child, the second excludes it and the third,
+ * used only for max_group_size == 2, includes it together with exactly one collected child.
+ * @param node The node (tree) whose children are finished
+ * @param pred The predecessor node (parent in the tree)
+ * @param node_presents Vector tracking the present count for each node
+ * @param vec_trees Vector of sets representing the graph of trees
+ * @param gifts Vector of gifts on each tree
+ * @param max_group_size The maximum size of the group allowed
+ * @return The maximum presents that can be collected from the node and its subtrees
+ */
+uint64_t collectPresents(ChristmasTree node, ChristmasTree pred,
+                         std::vector<std::tuple<size_t, size_t, size_t>> &node_presents,
+                         const std::vector<std::set<ChristmasTree>> &vec_trees,
+                         const std::vector<uint64_t> &gifts, int max_group_size) {
+    size_t accumulate_with = gifts[node];
+    size_t accumulate_without = 0;
+    size_t accumulate_paired = 0;
+    for (const auto &neigh: vec_trees[node]) {
+        if (neigh == pred)
+            continue;
+        const auto &[with, without, paired] = node_presents[neigh];
+        if (max_group_size == 2) {
+            // Pair the node with this child, or keep the pair found among the previous children
+            accumulate_paired = std::max(accumulate_paired + without, accumulate_with + with);
+            accumulate_without += std::max(std::max(with, without), paired);
+        } else
+            accumulate_without += std::max(with, without);
+        accumulate_with += without;
+    }
+    node_presents[node] = {accumulate_with, accumulate_without, accumulate_paired};
+    return std::max(std::max(accumulate_with, accumulate_without), accumulate_paired);
+}
+
 /**
  * Recursive function to solve the tree problem by calculating the maximum presents that can be collected.
- * @param root The root of the tree being processed
  * @param node The current node (tree) being processed
  * @param pred The predecessor node (parent in the tree)
- * @param checked_nodes Set of nodes that have already been processed
  * @param node_presents Vector tracking the present count for each node
  * @param vec_trees Vector of sets representing the graph of trees
  * @param gifts Vector of gifts on each tree
+ * @param max_group_size The maximum size of the group allowed
  * @return The maximum presents that can be collected from the current node and its subtrees
  */
-uint64_t solve_rec(const ChristmasTree &root, ChristmasTree &node, size_t pred, std::set<ChristmasTree> &checked_nodes,
-                   std::vector<std::pair<size_t, size_t>> &node_presents,
+uint64_t solve_rec(ChristmasTree node, ChristmasTree pred,
+                   std::vector<std::tuple<size_t, size_t, size_t>> &node_presents,
                    const std::vector<std::set<ChristmasTree>> &vec_trees,
-                   const std::vector<uint64_t> &gifts) {
+                   const std::vector<uint64_t> &gifts, int max_group_size) {
 
     // Recursively process each neighboring node (child nodes in the tree)
-    for (auto neigh: vec_trees[node]) {
-        if (!checked_nodes.count(neigh)) {
-            checked_nodes.emplace(node); // Mark the current node as checked
-            solve_rec(root, neigh, node, checked_nodes, node_presents, vec_trees, gifts);
-        }
-    }
+    for (auto neigh: vec_trees[node])
+        if (neigh != pred)
+            solve_rec(neigh, node, node_presents, vec_trees, gifts, max_group_size);
 
-    // If the current node is a leaf node and not the root, initialize its presents
-    if (vec_trees[node].size() == 1 && node != root) {
-        node_presents[node].first = gifts[node];
-        node_presents[node].second = 0;
-    } else {
-        // Calculate the total presents if the node is included or excluded in the collection
-        size_t accumulate_with = gifts[node];
-        size_t accumulate_without = 0;
-        for (const auto &neigh: vec_trees[node]) {
-            accumulate_with += node_presents[neigh].second;
-            accumulate_without += std::max(node_presents[neigh].first, node_presents[neigh].second);
+    return collectPresents(node, pred, node_presents, vec_trees, gifts, max_group_size);
+}
+
+/**
+ * Function to solve the tree problem like solve_rec, but with the call stack replaced by a vector of frames.
+ * A frame remembers the next neighbour to descend into, so the nodes are finished in the same order as by solve_rec.
+ * @param root The root of the tree
+ * @param node_presents Vector tracking the present count for each node
+ * @param vec_trees Vector of sets representing the graph of trees
+ * @param gifts Vector of gifts on each tree
+ * @param max_group_size The maximum size of the group allowed
+ * @return The maximum presents that can be collected from the root and its subtrees
+ */
+uint64_t solve_stack(ChristmasTree root,
+                     std::vector<std::tuple<size_t, size_t, size_t>> &node_presents,
+                     const std::vector<std::set<ChristmasTree>> &vec_trees,
+                     const std::vector<uint64_t> &gifts, int max_group_size) {
+    struct Frame {
+        ChristmasTree node; // The current node
+        ChristmasTree pred; // Its predecessor
+        std::set<ChristmasTree>::const_iterator next; // The next neighbour to descend into
+    };
+    std::vector<Frame> stack;
+    stack.push_back({root, NO_TREE, vec_trees[root].begin()});
+    uint64_t max = 0;
+
+    while (!stack.empty()) {
+        Frame &top = stack.back();
+        if (top.next != vec_trees[top.node].end()) {
+            ChristmasTree neigh = *top.next++;
+            if (neigh != top.pred)
+                stack.push_back({neigh, top.node, vec_trees[neigh].begin()}); // top is invalidated here
+            continue;
         }
-        node_presents[node].first = accumulate_with;
-        node_presents[node].second = accumulate_without;
+        max = collectPresents(top.node, top.pred, node_presents, vec_trees, gifts, max_group_size);
+        stack.pop_back();
     }
-    return std::max(node_presents[node].first, node_presents[node].second); // Return the maximum presents for the node
+    return max;
 }
 
 /**
  * Function to solve the TreeProblem using a recursive approach.
  * @param treeProblem The problem instance containing the group size, gifts, and connections
+ * @param traversal Whether to recurse on the call stack or to keep the frames in a vector
  * @return The maximum presents that can be collected
  */
-uint64_t solve(const TreeProblem &treeProblem) {
+uint64_t solve(const TreeProblem &treeProblem, Traversal traversal) {
     std::vector<std::set<ChristmasTree>> vec_trees(
             treeProblem.gifts.size()); // Vector for graph representation of the trees
     getGraphRepresentation(treeProblem.connections, vec_trees); // Build the graph
     ChristmasTree root = 0; // Start with the root node (tree)
-    std::set<ChristmasTree> checked_nodes; // Set to keep track of checked nodes
-    std::vector<std::pair<size_t, size_t>> node_presents(treeProblem.gifts.size()); // Vector to store presents information for each node
-    uint64_t max = solve_rec(root, root, 999999, checked_nodes, node_presents, vec_trees, treeProblem.gifts); // Solve recursively
-    return max; // Return the maximum presents that can be collected
+    std::vector<std::tuple<size_t, size_t, size_t>> node_presents(treeProblem.gifts.size()); // Vector to store presents information for each node
+    if (traversal == Traversal::RECURSIVE)
+        return solve_rec(root, NO_TREE, node_presents, vec_trees, treeProblem.gifts, treeProblem.max_group_size);
+    return solve_stack(root, node_presents, vec_trees, treeProblem.gifts, treeProblem.max_group_size);
+}
+
+/**
+ * Function to solve the TreeProblem with the explicit stack, which is safe for trees of any depth.
+ * @param treeProblem The problem instance containing the group size, gifts, and connections
+ * @return The maximum presents that can be collected
+ */
+uint64_t solve(const TreeProblem &treeProblem) {
+    return solve(treeProblem, Traversal::EXPLICIT_STACK);
 }
 
 #ifndef __PROGTEST__
@@ -108,6 +179,7 @@ using TestCase = std::pair<uint64_t, TreeProblem>; // Alias for a test case
 
 // Basic test cases for the TreeProblem
 const std::vector<TestCase> BASIC_TESTS = {
+        {37,  {2, {2,  3,  4,  5,  6,  7,  8,  9}, {{0,  1},  {1,  2},  {2,  3},  {3,  4},  {3, 5}, {3,  6},  {6,  7}}}},
         {3,   {1, {1,  1,  1,  2}, {{0,  3},  {1,  3},  {2,  3}}}},
         {4,   {1, {1,  1,  1,  4}, {{0,  3},  {1,  3},  {2,  3}}}},
         {57,  {1, {
@@ -150,20 +222,36 @@ const std::vector<TestCase> BONUS_TESTS = {
 void test(const std::vector<TestCase> &T) {
     int i = 0;
     for (auto &[s, t]: T) {
-        if (s != solve(t))
-            std::cout << "Error in " << i << " (returned " << std::endl << solve(t) << ")" << std::endl;
+        for (auto traversal: {Traversal::RECURSIVE, Traversal::EXPLICIT_STACK})
+            if (s != solve(t, traversal))
+                std::cout << "Error in " << i << " (returned " << std::endl << solve(t, traversal) << ")" << std::endl;
         i++;
     }
     std::cout << "Finished" << std::endl;
 }
 
+/**
+ * Function to check the explicit stack on a path far deeper than the call stack allows.
+ * Collecting every other tree is optimal for group size 1 and two of every three for group size 2.
+ */
+void testDeepPath() {
+    TreeProblem path{1, std::vector<uint64_t>(1000000, 1), {}};
+    for (ChristmasTree i = 1; i < path.gifts.size(); i++)
+        path.connections.emplace_back(i - 1, i);
+    assert(solve(path, Traversal::EXPLICIT_STACK) == 500000);
+    path.max_group_size = 2;
+    assert(solve(path, Traversal::EXPLICIT_STACK) == 666667);
+    std::cout << "Finished" << std::endl;
+}
+
 /**
  * Main function to execute the test cases.
  * @return 0 if all tests pass
  */
 int main() {
     test(BASIC_TESTS);
-    // test(BONUS_TESTS);
+    test(BONUS_TESTS);
+    testDeepPath();
 }
 
 #endif